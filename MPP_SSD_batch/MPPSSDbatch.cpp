@@ -0,0 +1,559 @@
+/*!
+ \file MPPSSDbatch.cpp
+ \brief Batch of Mixture of Photometric Potentials (MPP) SSD spherical camera orientation estimations (3 DOFs), the jobs of a manifest being run in a single process on a work-stealing thread pool, exploiting PeR core, core_extended, io, features, estimation and sensor_pose_estimation modules
+ * example command line :
+ *  ./MPPSSDbatch /Users/guillaume/Acquisitions/gyrovisu/spherique/gyro/jobs.txt 0
+ * example job line (the parameters of MPPSSDgyroEstim, then the optional output directory and key image switching threshold) :
+ *  /Users/guillaume/Acquisitions/gyrovisu/spherique/gyro/SVMIS/calib/resultats/calib_subdiv3.xml 3 0.325 /Users/guillaume/Acquisitions/gyrovisu/spherique/gyro/wheelchairESIGELEC/sequence/subdiv3/ 1 1 850 1 /Users/guillaume/Acquisitions/gyrovisu/spherique/gyro/wheelchairESIGELEC/sequence/subdiv3/maskFull.png 1 1 /Users/guillaume/Acquisitions/gyrovisu/spherique/gyro/wheelchairESIGELEC/lg0p325/
+ \param jobsFile the job manifest, one job per line: xmlFic subDiv lambda_g imDir iRef i0 i360 iStep Mask nbTries estimationType [outDir [seuilErr]], empty lines and lines starting with # being skipped
+ \param nbThreads the number of threads (0, the default, for the number of cores), every job running on one thread
+ \param frameCacheSize the maximum number of decoded images kept in memory for the jobs processing the same images (BATCH_FRAME_CACHE_SIZE by default)
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#include <iostream>
+#include <iomanip>
+
+#include <per/prStereoModel.h>
+
+#include <per/prStereoModelXML.h>
+#include <per/prRegularlySampledCSImage.h>
+
+#include <per/prPhotometricGMS.h>
+#include <per/prFeaturesSet.h>
+
+#include <per/prSSDCmp.h>
+
+#include <per/prPoseSphericalEstim.h>
+
+#include <boost/regex.hpp>
+#include <boost/filesystem.hpp>
+
+#include <visp/vpImage.h>
+#include <visp/vpImageIo.h>
+
+#include <visp/vpTime.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "MPPSSDgyro.h"
+
+//#define VERBOSE
+
+//maximum number of decoded images kept in memory by default (dual fisheye images of a few MB each)
+#define BATCH_FRAME_CACHE_SIZE 256
+
+//default MPP-SSD threshold of the key image switching (OK for lambda_g 0.325 at subdivision level 3)
+#define BATCH_SEUIL_ERR 0.0325
+
+/*!
+ * \class ResourceCache
+ * \brief Resources shared read-only by the jobs (spherical geometries, images indices, decoded images), loaded once by the first job asking for them while the other ones wait for them
+ *
+ * If capacity is not 0, the least recently used resources beyond capacity are dropped from the cache (the jobs still using them keep them alive).
+ */
+template<typename Value>
+class ResourceCache
+{
+public:
+    typedef std::shared_ptr<Value> Pointer;
+
+    ResourceCache(unsigned int capacity = 0) : capacity(capacity), nbLoads(0), nbHits(0) {}
+
+    /*!
+     * \fn Pointer get(const std::string &key, const std::function<Pointer()> &loader)
+     * \brief The resource of key, loaded by loader if it is not in the cache (the exceptions of loader being thrown to every job waiting for it)
+     */
+    Pointer get(const std::string &key, const std::function<Pointer()> &loader)
+    {
+        std::shared_future<Pointer> future;
+        std::promise<Pointer> promise;
+        bool load = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            typename std::map<std::string, Entry>::iterator it = entries.find(key);
+            if(it != entries.end())
+            {
+                recent.splice(recent.begin(), recent, it->second.position);
+                future = it->second.future;
+                nbHits++;
+            }
+            else
+            {
+                recent.push_front(key);
+                Entry &entry = entries[key];
+                entry.future = future = promise.get_future().share();
+                entry.position = recent.begin();
+                load = true;
+                nbLoads++;
+                while((capacity > 0) && (entries.size() > capacity))
+                {
+                    entries.erase(recent.back());
+                    recent.pop_back();
+                }
+            }
+        }
+        if(load)
+        {
+            try
+            {
+                promise.set_value(loader());
+            }
+            catch(...)
+            {
+                promise.set_exception(std::current_exception());
+            }
+        }
+        return future.get();
+    }
+
+    unsigned long getNbLoads() { std::unique_lock<std::mutex> lock(mutex); return nbLoads; }
+    unsigned long getNbHits() { std::unique_lock<std::mutex> lock(mutex); return nbHits; }
+
+private:
+    struct Entry
+    {
+        std::shared_future<Pointer> future;
+        std::list<std::string>::iterator position;
+    };
+
+    unsigned int capacity;
+    unsigned long nbLoads, nbHits;
+    std::map<std::string, Entry> entries;
+    std::list<std::string> recent; //keys, most recently used first
+    std::mutex mutex;
+};
+
+/*!
+ * \struct SphereGeometry
+ * \brief Subdivided icosahedron sampling of a subdivision level (spherical image and Gaussian samples directions), copied by every job of this level instead of being subdivided again
+ */
+struct SphereGeometry
+{
+    SphereGeometry(unsigned int subdivLevel) : IS(subdivLevel), GS(subdivLevel)
+    {
+        IS.setInterpType(prInterpType::IMAGEPLANE_BILINEAR);
+    }
+
+    prRegularlySampledCSImage<unsigned char> IS;
+    prRegularlySampledCSImage<float> GS;
+};
+
+/*!
+ * \struct BatchCaches
+ * \brief Caches of the resources shared by the jobs
+ */
+struct BatchCaches
+{
+    BatchCaches(unsigned int frameCacheSize) : frames(frameCacheSize) {}
+
+    ResourceCache<SphereGeometry> geometries; //per subdivision level
+    ResourceCache<std::vector<std::string> > indices; //image files of every image number, per directory
+    ResourceCache<vpImage<unsigned char> > frames; //decoded images and masks, per file
+};
+
+/*!
+ * \struct BatchJob
+ * \brief Parameters of a job (those of MPPSSDgyroEstim), its output directory and its results summary
+ */
+struct BatchJob
+{
+    BatchJob() : subdivLevel(3), lambda_g(0.325f), iRef(0), i0(0), i360(0), iStep(1), nbTries(1), estimationType(0), seuilErr(BATCH_SEUIL_ERR), cost(0.), done(false), nbImages(0), temps(0.) {}
+
+    unsigned int line;
+    std::string xmlFic, imDir, maskFic, outDir;
+    unsigned int subdivLevel;
+    float lambda_g;
+    unsigned int iRef, i0, i360, iStep, nbTries, estimationType;
+    double seuilErr;
+    double cost; //relative processing cost, to deal the most expensive jobs first
+
+    bool done;
+    std::string message;
+    unsigned int nbImages;
+    double temps; //ms
+};
+
+/*!
+ * \fn bool parseJob(const std::string &line, BatchJob &job)
+ * \brief Reads the parameters of a job from a manifest line, false if the line is not a job (empty or comment) or lacks parameters
+ */
+bool parseJob(const std::string &line, BatchJob &job)
+{
+    std::istringstream iss(line);
+    std::string first;
+    if(!(iss >> first) || (first[0] == '#'))
+        return false;
+    job.xmlFic = first;
+    if(!(iss >> job.subdivLevel >> job.lambda_g >> job.imDir >> job.iRef >> job.i0 >> job.i360 >> job.iStep >> job.maskFic >> job.nbTries >> job.estimationType))
+        return false;
+    if(!(iss >> job.outDir))
+        job.outDir = job.imDir;
+    if(!(iss >> job.seuilErr))
+        job.seuilErr = BATCH_SEUIL_ERR;
+    if(job.iStep == 0)
+        job.iStep = 1;
+    if(job.nbTries == 0)
+        job.nbTries = 1;
+    if(job.estimationType > 2)
+        job.estimationType = 0;
+
+    //the cost of an image grows as the number of spherical samples (4 times more per subdivision level) times the number of initial guesses
+    unsigned int nbImages = (job.i360 >= job.i0) ? (job.i360-job.i0)/job.iStep + 1 : 0;
+    job.cost = nbImages*pow(4., (double)job.subdivLevel)*((job.estimationType == 0) ? job.nbTries : 1);
+    return true;
+}
+
+/*!
+ * \class WorkStealingPool
+ * \brief Threads running the tasks of their own queue (most expensive first), then stealing the tasks at the other end of the queues of the other threads (least expensive first) once their queue is empty
+ */
+class WorkStealingPool
+{
+public:
+    WorkStealingPool(unsigned int nbThreads) : queues(std::max(nbThreads, 1u)), mutexes(std::max(nbThreads, 1u)), nbSteals(0) {}
+
+    unsigned int size() const { return queues.size(); }
+    unsigned int getNbSteals() const { return nbSteals; }
+
+    /*!
+     * \fn void run(const std::vector<unsigned int> &tasks, const std::function<void(unsigned int, unsigned int)> &f)
+     * \brief Runs f(task, thread) for every task, the tasks (in decreasing cost order) being dealt round robin to the queues, and returns once every task is done
+     */
+    void run(const std::vector<unsigned int> &tasks, const std::function<void(unsigned int, unsigned int)> &f)
+    {
+        unsigned int nbThreads = queues.size();
+        for(unsigned int i = 0 ; i < tasks.size() ; i++)
+            queues[i % nbThreads].push_back(tasks[i]);
+
+        std::vector<std::thread> threads;
+        for(unsigned int t = 0 ; t < nbThreads ; t++)
+            threads.push_back(std::thread([this, t, &f]
+            {
+                unsigned int task;
+                while(pop(t, task))
+                    f(task, t);
+            }));
+        for(unsigned int t = 0 ; t < nbThreads ; t++)
+            threads[t].join();
+    }
+
+private:
+    /*!
+     * \fn bool pop(unsigned int t, unsigned int &task)
+     * \brief Next task of the thread t, from the front of its queue or from the back of another one, false if every queue is empty (the tasks do not spawn tasks)
+     */
+    bool pop(unsigned int t, unsigned int &task)
+    {
+        unsigned int nbThreads = queues.size();
+        {
+            std::unique_lock<std::mutex> lock(mutexes[t]);
+            if(!queues[t].empty())
+            {
+                task = queues[t].front();
+                queues[t].pop_front();
+                return true;
+            }
+        }
+        for(unsigned int k = 1 ; k < nbThreads ; k++)
+        {
+            unsigned int v = (t + k) % nbThreads;
+            std::unique_lock<std::mutex> lock(mutexes[v]);
+            if(!queues[v].empty())
+            {
+                task = queues[v].back();
+                queues[v].pop_back();
+                nbSteals++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::deque<unsigned int> > queues;
+    std::vector<std::mutex> mutexes;
+    std::atomic<unsigned int> nbSteals;
+};
+
+/*!
+ * \fn void runJob(BatchJob &job, BatchCaches &caches)
+ * \brief Orientation estimation of the images of a job (pure gyro, odometry or odometry with key images, Gauss-Newton law of prPoseSphericalEstim, initial guesses grid of nbTries for pure gyro),
+ * saving the MPP-SSD, poses, processing times, key images and iterations to the usual files of MPPSSDgyroEstim in outDir
+ *
+ * The spherical geometry, the images index and the decoded images come from the caches, the calibration and the mask being copies of the job.
+ */
+void runJob(BatchJob &job, BatchCaches &caches)
+{
+    double tJob = vpTime::measureTimeMs();
+
+    //images index, reference image and mask, shared by the jobs
+    std::shared_ptr<std::vector<std::string> > v_imFiles = caches.indices.get(job.imDir, [&job]
+    {
+        std::shared_ptr<std::vector<std::string> > files = std::make_shared<std::vector<std::string> >();
+        boost::regex my_filter("([0-9]{6}).*\\.png");
+        boost::smatch imNumMatch;
+        std::string name;
+        for (boost::filesystem::directory_iterator iter(job.imDir),end; iter!=end; ++iter)
+        {
+            name = iter->path().filename().string();
+            if (boost::regex_match(name, imNumMatch, my_filter))
+            {
+                unsigned int num = atoi(imNumMatch[1].str().c_str());
+                if(num >= files->size())
+                    files->resize(num+1);
+                if((*files)[num].empty())
+                    (*files)[num] = iter->path().string();
+            }
+        }
+        return files;
+    });
+    std::function<std::shared_ptr<vpImage<unsigned char> >(unsigned int)> frame = [&caches, &v_imFiles](unsigned int num)
+    {
+        if((num >= v_imFiles->size()) || (*v_imFiles)[num].empty())
+            throw std::runtime_error("missing image " + std::to_string(num));
+        const std::string &file = (*v_imFiles)[num];
+        return caches.frames.get(file, [&file]
+        {
+            std::shared_ptr<vpImage<unsigned char> > I = std::make_shared<vpImage<unsigned char> >();
+            vpImageIo::read(*I, file);
+            return I;
+        });
+    };
+    std::shared_ptr<vpImage<unsigned char> > I_req = frame(job.iRef);
+    
+    //only a loaded mask is cached: the full mask replacing a mask file that cannot be loaded is of the size of the images of the job, which may differ from the ones of the other jobs of this mask file
+    std::shared_ptr<vpImage<unsigned char> > maskShared;
+    try
+    {
+        maskShared = caches.frames.get(job.maskFic, [&job]
+        {
+            std::shared_ptr<vpImage<unsigned char> > M = std::make_shared<vpImage<unsigned char> >();
+            vpImageIo::read(*M, job.maskFic);
+            return M;
+        });
+    }
+    catch(vpException &)
+    {
+        std::cout << "unable to load mask file " << job.maskFic << std::endl;
+        maskShared = std::make_shared<vpImage<unsigned char> >();
+        maskShared->resize(I_req->getHeight(), I_req->getWidth(), 255);
+    }
+
+    //spherical images of the job, copied from the shared geometry of its subdivision level, with its own calibration (loaded by every job since buildFromTwinOmni takes a non-const stereo rig model,
+    //whose copies would share their sensors) and its own copy of the mask, for the same reason
+    std::shared_ptr<SphereGeometry> geometry = caches.geometries.get(std::to_string(job.subdivLevel), [&job]
+    {
+        return std::make_shared<SphereGeometry>(job.subdivLevel);
+    });
+    TwinOmniSampler sampler(job.xmlFic.c_str(), *maskShared, geometry->IS, geometry->GS, job.lambda_g);
+
+    bool dofs[6] = {false, false, false, true, true, true}; //"gyro"
+    bool robust = false;
+    MPPGyroRegistration registration(dofs, robust, job.seuilErr);
+
+    std::ostringstream s;
+    std::string filename;
+    s << job.outDir << "/iter_" << job.iRef << "_" << job.i0 << "_" << job.i360 << ".txt";
+    filename = s.str();
+    registration.gyro.startSaveIterations((char *)filename.c_str());
+
+    //the images of the job are tracked against the reference image by the sequence loop shared with the segment-parallel odometry of MPPSSDgyroEstim
+    SequenceTrack seq;
+    for(unsigned int imNum = job.i0 ; imNum <= job.i360 ; imNum += job.iStep)
+        seq.v_imNum.push_back(imNum);
+    std::vector<vpPoseVector> v_r_tries;
+    if((job.estimationType == 0) && (job.nbTries > 1))
+        rotationGrid(job.nbTries, dofs, v_r_tries);
+    trackSequence(seq, I_req.get(), frame, sampler, registration, job.estimationType, v_r_tries, robust);
+    const std::vector<double> &err = seq.v_err, &v_temps = seq.v_temps;
+    const std::vector<vpPoseVector> &pv = seq.v_pose;
+    std::vector<unsigned int> v_keyImageNum;
+    if(job.estimationType == 2)
+        v_keyImageNum = seq.v_keys;
+    unsigned int nbPass = seq.v_pose.size();
+
+    //save the MPP-SSD at optimal poses, optimal poses, processing times and key images numbers to files
+    s.str("");
+    s << job.outDir << "/errors_" << job.iRef << "_" << job.i0 << "_" << job.i360 << ".txt";
+    filename = s.str();
+    std::ofstream ficerrMin(filename.c_str());
+    for(unsigned int i = 0 ; i < err.size() ; i++)
+        ficerrMin << err[i] << std::endl;
+    ficerrMin.close();
+
+    s.str("");
+    s << job.outDir << "/poses_" << job.iRef << "_" << job.i0 << "_" << job.i360 << ".txt";
+    filename = s.str();
+    std::ofstream ficPoses(filename.c_str());
+    for(unsigned int i = 0 ; i < pv.size() ; i++)
+        ficPoses << pv[i].t() << std::endl;
+    ficPoses.close();
+
+    s.str("");
+    s << job.outDir << "/time_" << job.iRef << "_" << job.i0 << "_" << job.i360 << ".txt";
+    filename = s.str();
+    std::ofstream ficTime(filename.c_str());
+    for(unsigned int i = 0 ; i < v_temps.size() ; i++)
+        ficTime << v_temps[i] << std::endl;
+    ficTime.close();
+
+    s.str("");
+    s << job.outDir << "/keys_" << job.iRef << "_" << job.i0 << "_" << job.i360 << ".txt";
+    filename = s.str();
+    std::ofstream ficKeys(filename.c_str());
+    for(unsigned int i = 0 ; i < v_keyImageNum.size() ; i++)
+        ficKeys << v_keyImageNum[i] << std::endl;
+    ficKeys.close();
+
+    job.nbImages = nbPass;
+    job.temps = vpTime::measureTimeMs()-tJob;
+}
+
+/*!
+ * \fn main()
+ * \brief Main function of the batch of MPP SSD based spherical orientation estimations
+ */
+int main(int argc, char **argv)
+{
+    //1. Lecture du manifeste des taches
+    if(argc < 2)
+    {
+#ifdef VERBOSE
+        std::cout << "no job manifest given" << std::endl;
+#endif
+        return -1;
+    }
+    std::vector<BatchJob> v_jobs;
+    {
+        std::ifstream ficJobs(argv[1]);
+        if(!ficJobs.is_open())
+        {
+            std::cout << "unable to open the job manifest " << argv[1] << std::endl;
+            return -1;
+        }
+        std::string line;
+        BatchJob job;
+        for(unsigned int l = 1 ; std::getline(ficJobs, line) ; l++)
+        {
+            job = BatchJob();
+            job.line = l;
+            if(parseJob(line, job))
+                v_jobs.push_back(job);
+            else if(!line.empty() && (line.find_first_not_of(" \t\r") != std::string::npos) && (line[line.find_first_not_of(" \t\r")] != '#'))
+                std::cout << "line " << l << " of the job manifest is incomplete, skipped" << std::endl;
+        }
+        ficJobs.close();
+    }
+    std::cout << v_jobs.size() << " jobs" << std::endl;
+    
+    //the output files of a job are named after iRef, i0 and i360 only: jobs of the same output directory must differ by these
+    {
+        std::map<std::string, unsigned int> outputs;
+        for(unsigned int j = 0 ; j < v_jobs.size() ; j++)
+        {
+            std::ostringstream s;
+            s << v_jobs[j].outDir << "/" << v_jobs[j].iRef << "_" << v_jobs[j].i0 << "_" << v_jobs[j].i360;
+            std::map<std::string, unsigned int>::iterator it = outputs.find(s.str());
+            if(it != outputs.end())
+                std::cout << "jobs of lines " << it->second << " and " << v_jobs[j].line << " write the same output files" << std::endl;
+            else
+                outputs[s.str()] = v_jobs[j].line;
+        }
+    }
+
+    //nombre de threads (0 : autant que de coeurs)
+    unsigned int nbThreads = 0;
+    if(argc < 3)
+    {
+#ifdef VERBOSE
+        std::cout << "no number of threads given" << std::endl;
+#endif
+    }
+    else
+        nbThreads = atoi(argv[2]);
+    if(nbThreads == 0)
+        nbThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    //nombre maximal d'images decodees gardees en memoire
+    unsigned int frameCacheSize = BATCH_FRAME_CACHE_SIZE;
+    if(argc < 4)
+    {
+#ifdef VERBOSE
+        std::cout << "no frame cache size given" << std::endl;
+#endif
+    }
+    else
+        frameCacheSize = atoi(argv[3]);
+
+    // 2. Execution des taches, les plus couteuses d'abord : les taches de meme cout (souvent les memes images) sont distribuees a des threads differents et partagent les images decodees
+    std::vector<unsigned int> v_order(v_jobs.size());
+    for(unsigned int i = 0 ; i < v_order.size() ; i++)
+        v_order[i] = i;
+    std::stable_sort(v_order.begin(), v_order.end(), [&v_jobs](unsigned int a, unsigned int b) { return v_jobs[a].cost > v_jobs[b].cost; });
+
+    BatchCaches caches(frameCacheSize);
+    WorkStealingPool pool(nbThreads);
+    std::mutex coutMutex;
+    double tBatch = vpTime::measureTimeMs();
+    pool.run(v_order, [&](unsigned int j, unsigned int t)
+    {
+        BatchJob &job = v_jobs[j];
+        try
+        {
+            runJob(job, caches);
+            job.done = true;
+        }
+        catch(vpException &e)
+        {
+            job.message = e.getMessage();
+        }
+        catch(std::exception &e)
+        {
+            job.message = e.what();
+        }
+        catch(...)
+        {
+            job.message = "unknown error";
+        }
+        std::unique_lock<std::mutex> lock(coutMutex);
+        if(job.done)
+            std::cout << "job of line " << job.line << " done by thread " << t << " : " << job.nbImages << " images in " << job.temps << " ms" << std::endl;
+        else
+            std::cout << "job of line " << job.line << " failed : " << job.message << std::endl;
+    });
+    tBatch = vpTime::measureTimeMs()-tBatch;
+
+    // 3. Bilan : temps, occupation des threads, efficacite des caches
+    unsigned int nbDone = 0, nbImages = 0;
+    double tJobs = 0.;
+    for(unsigned int j = 0 ; j < v_jobs.size() ; j++)
+        if(v_jobs[j].done)
+        {
+            nbDone++;
+            nbImages += v_jobs[j].nbImages;
+            tJobs += v_jobs[j].temps;
+        }
+    std::cout << nbDone << "/" << v_jobs.size() << " jobs done (" << nbImages << " images) in " << tBatch << " ms on " << pool.size() << " threads, " << pool.getNbSteals() << " steals, ";
+    std::cout << "threads occupation " << ((tBatch > 0.) ? 100.*tJobs/(tBatch*pool.size()) : 0.) << "%" << std::endl;
+    std::cout << "caches (loads / hits) : geometries " << caches.geometries.getNbLoads() << " / " << caches.geometries.getNbHits()
+              << ", images " << caches.frames.getNbLoads() << " / " << caches.frames.getNbHits() << std::endl;
+
+    return (nbDone == v_jobs.size()) ? 0 : -2;
+}
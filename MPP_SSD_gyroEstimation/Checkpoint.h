@@ -0,0 +1,207 @@
+/*!
+ \file Checkpoint.h
+ \brief Checkpoints of the sequential loop (checkpointPeriod, resume): binary serialization of the tracker state and its asynchronous writing to file
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef Checkpoint_h
+#define Checkpoint_h
+
+#include <visp/vpHomogeneousMatrix.h>
+#include <visp/vpPoseVector.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//checkpoint file: magic number and format version
+#define CHECKPOINT_MAGIC 0x4b435050u
+#define CHECKPOINT_VERSION 2u
+
+/*!
+ * \class Checkpoint
+ * \brief Binary serialization of the tracker state (native endianness and sizes, to be read back on the same platform), doubles being stored bit for bit
+ */
+class Checkpoint
+{
+public:
+    Checkpoint() : pos(0) {}
+    
+    void clear()
+    {
+        data.clear();
+        pos = 0;
+    }
+    
+    template<typename T>
+    void put(const T &x)
+    {
+        const char *p = (const char *)&x;
+        data.insert(data.end(), p, p+sizeof(T));
+    }
+    
+    void put(const vpPoseVector &r)
+    {
+        for(unsigned int k = 0 ; k < 6 ; k++)
+            put(r[k]);
+    }
+    
+    void put(const vpHomogeneousMatrix &M)
+    {
+        for(unsigned int k = 0 ; k < 4 ; k++)
+            for(unsigned int m = 0 ; m < 4 ; m++)
+                put(M[k][m]);
+    }
+    
+    template<typename T>
+    void put(const std::vector<T> &v)
+    {
+        put((unsigned long long)v.size());
+        for(unsigned int i = 0 ; i < v.size() ; i++)
+            put(v[i]);
+    }
+    
+    /*!
+     * \fn template<typename T> bool get(T &x)
+     * \brief Reads the next value, false (x unchanged) if the data is over
+     */
+    template<typename T>
+    bool get(T &x)
+    {
+        if(pos + sizeof(T) > data.size())
+            return false;
+        std::copy(data.begin()+pos, data.begin()+pos+sizeof(T), (char *)&x);
+        pos += sizeof(T);
+        return true;
+    }
+    
+    bool get(vpPoseVector &r)
+    {
+        bool ok = true;
+        for(unsigned int k = 0 ; k < 6 ; k++)
+            ok = ok && get(r[k]);
+        return ok;
+    }
+    
+    bool get(vpHomogeneousMatrix &M)
+    {
+        bool ok = true;
+        for(unsigned int k = 0 ; k < 4 ; k++)
+            for(unsigned int m = 0 ; m < 4 ; m++)
+                ok = ok && get(M[k][m]);
+        return ok;
+    }
+    
+    template<typename T>
+    bool get(std::vector<T> &v)
+    {
+        unsigned long long n;
+        if(!get(n) || (n > data.size()))
+            return false;
+        v.resize(n);
+        bool ok = true;
+        for(unsigned int i = 0 ; (i < n) && ok ; i++)
+            ok = get(v[i]);
+        return ok;
+    }
+    
+    /*!
+     * \fn bool load(const char *filename)
+     * \brief Reads the whole file, false if it cannot be opened
+     */
+    bool load(const char *filename)
+    {
+        clear();
+        std::ifstream fic(filename, std::ios::in | std::ios::binary);
+        if(!fic.is_open())
+            return false;
+        data.assign(std::istreambuf_iterator<char>(fic), std::istreambuf_iterator<char>());
+        fic.close();
+        return true;
+    }
+    
+    std::vector<char> data;
+    
+private:
+    size_t pos;
+};
+
+/*!
+ * \class CheckpointWriter
+ * \brief Writes the checkpoints to file in a thread of its own, so that the tracking loop only pays for the serialization
+ *
+ * A checkpoint posted while the previous one is being written replaces the one waiting, if any (only the latest matters).
+ * Every checkpoint is written to a temporary file then renamed, so that the file always holds a complete checkpoint.
+ */
+class CheckpointWriter
+{
+public:
+    CheckpointWriter(const std::string &filename) : filename(filename), pending(false), stop(false), writer(&CheckpointWriter::run, this) {}
+    
+    ~CheckpointWriter()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv.notify_one();
+        writer.join();
+    }
+    
+    /*!
+     * \fn void post(Checkpoint &checkpoint)
+     * \brief Hands the serialized state over to the writing thread (checkpoint then holds a former buffer, to be cleared before reuse)
+     */
+    void post(Checkpoint &checkpoint)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            waiting.swap(checkpoint.data);
+            pending = true;
+        }
+        cv.notify_one();
+    }
+    
+private:
+    void run()
+    {
+        std::string filenameTmp = filename + ".tmp";
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;)
+        {
+            cv.wait(lock, [this] { return pending || stop; });
+            if(!pending)
+                break;
+            writing.swap(waiting);
+            pending = false;
+            lock.unlock();
+            
+            std::ofstream fic(filenameTmp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+            fic.write(writing.data(), writing.size());
+            fic.close();
+            if(fic.fail() || (std::rename(filenameTmp.c_str(), filename.c_str()) != 0))
+                std::cout << "unable to write the checkpoint " << filename << std::endl;
+            
+            lock.lock();
+        }
+    }
+    
+    std::string filename;
+    std::vector<char> waiting, writing;
+    bool pending, stop;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread writer;
+};
+
+#endif //Checkpoint_h
@@ -0,0 +1,121 @@
+/*!
+ \file FrameScheduler.h
+ \brief Real-time scheduling of the images of the sequential loop (schedulePolicy): every image, drop-to-latest or adaptive step, and end-to-end latencies
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef FrameScheduler_h
+#define FrameScheduler_h
+
+#include <visp/vpTime.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//real-time scheduling: period (ms) of the images when no acquisition times file is given, and replay speed (times real time) of the acquisition times
+#define FRAME_PERIOD 33.3
+#define REPLAY_SPEED 1.
+//real-time scheduling, adaptive step: maximum multiple of iStep, latency ratio to the target below which the step decreases
+#define SCHEDULE_MAX_STEP 8
+#define SCHEDULE_DECREASE 0.5
+
+/*!
+ * \class FrameScheduler
+ * \brief Real-time scheduling of the images of the sequential loop, as they would arrive from a live camera (acquisition times file, or FRAME_PERIOD), replayed at REPLAY_SPEED
+ *
+ * Policies: 0 every image (iStep apart) as soon as possible (offline), 1 drop-to-latest: the loop waits for the arrival of the next image and then processes the latest arrived one, skipping the backlog,
+ * 2 adaptive step: the loop waits for the arrival of the next image, the step growing by iStep while the end-to-end latency of an image exceeds the target and decreasing once it gets below SCHEDULE_DECREASE times the target.
+ * The end-to-end latency of an image is the time from its arrival to the end of its processing.
+ */
+class FrameScheduler
+{
+public:
+    enum { ALL, DROP_TO_LATEST, ADAPTIVE_STEP };
+    
+    FrameScheduler(unsigned int policy, double latencyTarget, unsigned int i0, unsigned int i360, unsigned int iStep, const std::vector<double> &v_frameTimes)
+        : policy(policy), latencyTarget(latencyTarget), i0(i0), i360(i360), iStep(iStep), step(1), nbDropped(0), tStart(0.), v_frameTimes(v_frameTimes) {}
+    
+    bool isRealTime() const { return policy != ALL; }
+    
+    /*!
+     * \fn double arrival(unsigned int imNum) const
+     * \brief Arrival time (ms, vpTime::measureTimeMs base) of the image imNum, the first image waited for arriving at the start of the loop
+     */
+    double arrival(unsigned int imNum) const
+    {
+        if((imNum < v_frameTimes.size()) && (i0 < v_frameTimes.size()) && !std::isnan(v_frameTimes[imNum]) && !std::isnan(v_frameTimes[i0]))
+            return tStart + 1000.*(v_frameTimes[imNum] - v_frameTimes[i0])/REPLAY_SPEED;
+        return tStart + (double(imNum) - double(i0))*FRAME_PERIOD/REPLAY_SPEED;
+    }
+    
+    /*!
+     * \fn void wait(unsigned int imNum)
+     * \brief Starts the clock at the first call, then waits for the arrival of the image imNum (real-time policies only)
+     */
+    void wait(unsigned int imNum)
+    {
+        if(!isRealTime())
+            return;
+        if(tStart == 0.)
+        {
+            tStart = vpTime::measureTimeMs();
+            tStart -= arrival(imNum) - tStart;
+        }
+        double dt = arrival(imNum) - vpTime::measureTimeMs();
+        if(dt > 0.)
+            vpTime::wait(dt);
+    }
+    
+    /*!
+     * \fn unsigned int next(unsigned int imNum)
+     * \brief Records the latency of the image imNum, whose processing just ended, and returns the number of the next image to process (greater than i360 at the end of the sequence)
+     */
+    unsigned int next(unsigned int imNum)
+    {
+        if(!isRealTime())
+            return imNum + iStep;
+        
+        double now = vpTime::measureTimeMs(), latency = now - arrival(imNum);
+        v_imNum.push_back(imNum);
+        v_latencies.push_back(latency);
+        
+        unsigned int imNext = imNum + iStep;
+        if(policy == DROP_TO_LATEST)
+        {
+            while((imNext + iStep <= i360) && (arrival(imNext + iStep) <= now))
+                imNext += iStep;
+        }
+        else
+        {
+            if(latency > latencyTarget)
+                step = std::min(step + 1, (unsigned int)SCHEDULE_MAX_STEP);
+            else if((latency < SCHEDULE_DECREASE*latencyTarget) && (step > 1))
+                step--;
+            imNext = imNum + step*iStep;
+        }
+        if(imNext <= i360)
+            nbDropped += (imNext - imNum)/iStep - 1;
+        else if(imNum + iStep <= i360)
+            nbDropped += (i360 - imNum)/iStep;
+        return imNext;
+    }
+    
+    unsigned int getNbDropped() const { return nbDropped; }
+    const std::vector<unsigned int> &getImageNumbers() const { return v_imNum; }
+    const std::vector<double> &getLatencies() const { return v_latencies; }
+    
+private:
+    unsigned int policy;
+    double latencyTarget;
+    unsigned int i0, i360, iStep, step, nbDropped;
+    double tStart;
+    const std::vector<double> &v_frameTimes;
+    std::vector<unsigned int> v_imNum;
+    std::vector<double> v_latencies;
+};
+
+#endif //FrameScheduler_h
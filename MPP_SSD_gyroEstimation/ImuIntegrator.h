@@ -0,0 +1,142 @@
+/*!
+ \file ImuIntegrator.h
+ \brief Inertial rate prior: log of the angular rates of a gyroscope, integrated between the acquisition times of two images
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef ImuIntegrator_h
+#define ImuIntegrator_h
+
+#include <visp/vpHomogeneousMatrix.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "RotationAveraging.h"
+
+//inertial rate prior: rotation (theta u, rad) of the IMU axes with respect to the camera ones
+#define IMU_TO_CAMERA_THETAU 0., 0., 0.
+
+/*!
+ * \class ImuIntegrator
+ * \brief Angular rates of a MEMS gyroscope logged with the images, integrated between the acquisition times of two images to predict their relative orientation
+ *
+ * The log is a text file of "t wx wy wz" lines (time in s, rates in rad/s about the IMU axes, lines not starting with 4 numbers being skipped), or a binary file (.bin extension) of 4 doubles per sample in the same order.
+ * The rates are linearly interpolated between the samples and integrated at the midpoint of every sub-interval, the IMU axes being rotated to the camera ones by IMU_TO_CAMERA_THETAU.
+ */
+class ImuIntegrator
+{
+public:
+    ImuIntegrator()
+    {
+        double thetaU[3] = {IMU_TO_CAMERA_THETAU};
+        rotationExp(thetaU, cRi);
+    }
+    
+    /*!
+     * \fn bool load(const char *filename)
+     * \brief Reads the samples (sorted by time), false if the file cannot be opened or holds less than 2 samples
+     */
+    bool load(const char *filename)
+    {
+        samples.clear();
+        std::string name(filename);
+        bool binary = (name.size() > 4) && (name.compare(name.size()-4, 4, ".bin") == 0);
+        std::ifstream fic(filename, binary ? std::ios::in | std::ios::binary : std::ios::in);
+        if(!fic.is_open())
+            return false;
+        
+        Sample sample;
+        if(binary)
+        {
+            while(fic.read((char *)sample.v, 4*sizeof(double)))
+                samples.push_back(sample);
+        }
+        else
+        {
+            std::string line;
+            while(std::getline(fic, line))
+            {
+                std::istringstream iss(line);
+                if(iss >> sample.v[0] >> sample.v[1] >> sample.v[2] >> sample.v[3])
+                    samples.push_back(sample);
+            }
+        }
+        fic.close();
+        
+        std::stable_sort(samples.begin(), samples.end(), [](const Sample &a, const Sample &b) { return a.v[0] < b.v[0]; });
+        if(samples.size() < 2)
+        {
+            samples.clear();
+            return false;
+        }
+        return true;
+    }
+    
+    unsigned int size() const { return samples.size(); }
+    
+    /*!
+     * \fn bool integrate(double t0, double t1, vpHomogeneousMatrix &dMc) const
+     * \brief Relative pose dMc of the camera from t0 to t1 (t0 < t1), with the convention of the estimated poses (the points of the camera frame at t0 expressed in the one at t1)
+     * \return false if [t0, t1] is not covered by the log (then dMc is unchanged)
+     */
+    bool integrate(double t0, double t1, vpHomogeneousMatrix &dMc) const
+    {
+        if(samples.empty() || !(t0 < t1) || (t0 < samples.front().v[0]) || (t1 > samples.back().v[0]))
+            return false;
+        
+        //R: orientation of the IMU at t1 in its frame at t0, right products of the increments expressed in the moving frame
+        double R[9] = {1., 0., 0., 0., 1., 0., 0., 0., 1.}, dR[9], Rn[9], w[3];
+        unsigned int i = 0;
+        while(samples[i+1].v[0] <= t0)
+            i++;
+        double ta = t0;
+        while(ta < t1)
+        {
+            double tb = std::min(t1, samples[i+1].v[0]);
+            if(tb > ta)
+            {
+                double tm = 0.5*(ta + tb), s = (tm - samples[i].v[0])/(samples[i+1].v[0] - samples[i].v[0]);
+                for(unsigned int k = 0 ; k < 3 ; k++)
+                    w[k] = ((1.-s)*samples[i].v[1+k] + s*samples[i+1].v[1+k])*(tb - ta);
+                rotationExp(w, dR);
+                mult3x3(R, dR, Rn);
+                for(unsigned int k = 0 ; k < 9 ; k++)
+                    R[k] = Rn[k];
+            }
+            ta = tb;
+            if((ta < t1) && (i+2 < samples.size()))
+                i++;
+        }
+        
+        //camera frame: cRi R cRi^T, the pose of the points being its transpose
+        double cR[9], Rt[9];
+        mult3x3(cRi, R, Rn);
+        for(unsigned int k = 0 ; k < 3 ; k++)
+            for(unsigned int m = 0 ; m < 3 ; m++)
+                Rt[3*k+m] = cRi[3*m+k];
+        mult3x3(Rn, Rt, cR);
+        dMc.eye();
+        for(unsigned int k = 0 ; k < 3 ; k++)
+            for(unsigned int m = 0 ; m < 3 ; m++)
+                dMc[k][m] = cR[3*m+k];
+        return true;
+    }
+    
+private:
+    struct Sample
+    {
+        double v[4];
+    };
+    
+    std::vector<Sample> samples;
+    double cRi[9];
+};
+
+#endif //ImuIntegrator_h
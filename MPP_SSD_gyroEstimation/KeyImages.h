@@ -0,0 +1,104 @@
+/*!
+ \file KeyImages.h
+ \brief Key images database of estimationType 2: retrieval descriptors of the key images, queried by signature among the key images of close cumulative orientation
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef KeyImages_h
+#define KeyImages_h
+
+#include <visp/vpHomogeneousMatrix.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+//key images database: maximum angle (rad) between the cumulative orientations of a new key image and of a stored one to be compared
+#define KEYS_MAX_ANGLE 0.5
+
+/*!
+ * \struct KeyImage
+ * \brief Key image of the database: its retrieval descriptors only (spherical harmonics signature and cumulative pose with respect to the reference image), its features sets and spectrum being rebuilt from its image file when needed
+ */
+struct KeyImage
+{
+    int imageNum; //-1 for the reference image
+    unsigned int imageFileNum; //number of its image file (iRef for the reference image)
+    std::vector<float> signature;
+    vpHomogeneousMatrix cumM;
+    double R[9]; //rotation of cumM, row major
+};
+
+/*!
+ * \class KeyImageDatabase
+ * \brief In-memory key images store, queried by linear scan over the signatures of the key images of close cumulative orientation
+ */
+class KeyImageDatabase
+{
+public:
+    ~KeyImageDatabase()
+    {
+        for(unsigned int k = 0 ; k < keys.size() ; k++)
+            delete keys[k];
+    }
+    
+    /*!
+     * \fn void add(KeyImage *key)
+     * \brief Stores the key image (the database takes its ownership)
+     */
+    void add(KeyImage *key)
+    {
+        for(unsigned int i = 0 ; i < 3 ; i++)
+            for(unsigned int j = 0 ; j < 3 ; j++)
+                key->R[3*i+j] = key->cumM[i][j];
+        keys.push_back(key);
+    }
+    
+    /*!
+     * \fn int query(const std::vector<float> &signature, const vpHomogeneousMatrix &cumM, int exclude = -1) const
+     * \brief Index of the key image of closest signature among the ones whose cumulative orientation is within KEYS_MAX_ANGLE of cumM (but exclude), -1 if none
+     */
+    int query(const std::vector<float> &signature, const vpHomogeneousMatrix &cumM, int exclude = -1) const
+    {
+        //angle(Ra^T Rb) <= a  <=>  trace(Ra^T Rb) = sum_ij Ra_ij Rb_ij >= 1 + 2 cos(a)
+        double R[9], traceMin = 1. + 2.*cos(KEYS_MAX_ANGLE);
+        for(unsigned int i = 0 ; i < 3 ; i++)
+            for(unsigned int j = 0 ; j < 3 ; j++)
+                R[3*i+j] = cumM[i][j];
+        int kBest = -1;
+        float distBest = std::numeric_limits<float>::max();
+        for(unsigned int k = 0 ; k < keys.size() ; k++)
+        {
+            if((int)k == exclude)
+                continue;
+            double trace = 0.;
+            for(unsigned int i = 0 ; i < 9 ; i++)
+                trace += R[i]*keys[k]->R[i];
+            if(trace < traceMin)
+                continue;
+            float dist = 0.f;
+            for(unsigned int l = 0 ; l < signature.size() ; l++)
+            {
+                float d = signature[l] - keys[k]->signature[l];
+                dist += d*d;
+            }
+            if(dist < distBest)
+            {
+                distBest = dist;
+                kBest = k;
+            }
+        }
+        return kBest;
+    }
+    
+    unsigned int size() const { return keys.size(); }
+    KeyImage &operator[](unsigned int k) { return *keys[k]; }
+    
+private:
+    std::vector<KeyImage *> keys;
+};
+
+#endif //KeyImages_h
@@ -0,0 +1,93 @@
+/*!
+ \file KeySwitchPolicy.h
+ \brief Key image switching policy of estimationType 2 (keyPolicy): fixed MPP-SSD threshold or threshold adapted to the noise floor of the MPP-SSD after every switch
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef KeySwitchPolicy_h
+#define KeySwitchPolicy_h
+
+#include <visp/vpPoseVector.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "Checkpoint.h"
+
+//adaptive key image switching: the threshold is KEY_ERR_GROWTH times the smoothed MPP-SSD of the images registered right after a key image switch (the noise floor), clamped to [KEY_THRESHOLD_MIN, KEY_THRESHOLD_MAX] times seuilErr
+#define KEY_ERR_GROWTH 2.5
+#define KEY_THRESHOLD_MIN 0.25
+#define KEY_THRESHOLD_MAX 4.
+//adaptive key image switching: maximum ratio of the iterations of an image to the smoothed iterations of the images registered right after a key image switch
+#define KEY_ITER_GROWTH 3.
+//adaptive key image switching: maximum rotation (rad) from the key image, beyond which the overlap of the images gets too low
+#define KEY_MAX_ROTATION 0.6
+//adaptive key image switching: smoothing factor of the noise floor (weight of the last image)
+#define KEY_SMOOTHING 0.3
+
+/*!
+ * \class KeySwitchPolicy
+ * \brief Decides, after the registration of every image, if it becomes the next key image (odometry with key images)
+ *
+ * Policies: 0 MPP-SSD greater than seuilErr, 1 adaptive: MPP-SSD greater than KEY_ERR_GROWTH times its noise floor, i.e. the smoothed MPP-SSD of the images registered right after a key image switch,
+ * or iterations greater than KEY_ITER_GROWTH times their floor (inverse compositional and ESM laws only), or rotation from the key image greater than KEY_MAX_ROTATION.
+ */
+class KeySwitchPolicy
+{
+public:
+    KeySwitchPolicy(unsigned int type, double seuilErr) : type(type), seuilErr(seuilErr), threshold(seuilErr), errFloor(0.), iterFloor(0.), nbFloor(0), afterSwitch(true) {}
+
+    /*!
+     * \fn bool decide(double err, unsigned int nbIterations, const vpPoseVector &r)
+     * \brief True if the image, registered with MPP-SSD err after nbIterations iterations (0 if unknown) at pose r with respect to the key image, becomes the next key image
+     */
+    bool decide(double err, unsigned int nbIterations, const vpPoseVector &r)
+    {
+        if(type != 1)
+            return (err > seuilErr);
+
+        if(afterSwitch)
+        {
+            errFloor = (nbFloor == 0) ? err : KEY_SMOOTHING*err + (1.-KEY_SMOOTHING)*errFloor;
+            iterFloor = (nbFloor == 0) ? nbIterations : KEY_SMOOTHING*nbIterations + (1.-KEY_SMOOTHING)*iterFloor;
+            nbFloor++;
+        }
+        threshold = std::min(std::max(KEY_ERR_GROWTH*errFloor, KEY_THRESHOLD_MIN*seuilErr), KEY_THRESHOLD_MAX*seuilErr);
+        
+        afterSwitch = (err > threshold)
+                   || ((nbIterations > 0) && (iterFloor > 0.) && (nbIterations > KEY_ITER_GROWTH*iterFloor))
+                   || (sqrt(r[3]*r[3] + r[4]*r[4] + r[5]*r[5]) > KEY_MAX_ROTATION);
+        return afterSwitch;
+    }
+    
+    /*!
+     * \fn double getThreshold() const
+     * \brief Current MPP-SSD threshold (also the one of the key images re-anchoring)
+     */
+    double getThreshold() const { return threshold; }
+    
+    void save(Checkpoint &checkpoint) const
+    {
+        checkpoint.put(threshold);
+        checkpoint.put(errFloor);
+        checkpoint.put(iterFloor);
+        checkpoint.put(nbFloor);
+        checkpoint.put(afterSwitch);
+    }
+    
+    bool load(Checkpoint &checkpoint)
+    {
+        return checkpoint.get(threshold) && checkpoint.get(errFloor) && checkpoint.get(iterFloor) && checkpoint.get(nbFloor) && checkpoint.get(afterSwitch);
+    }
+
+private:
+    unsigned int type;
+    double seuilErr, threshold, errFloor, iterFloor;
+    unsigned int nbFloor;
+    bool afterSwitch;
+};
+
+#endif //KeySwitchPolicy_h
@@ -0,0 +1,142 @@
+/*!
+ \file MPPFeatures.h
+ \brief Numerical rotation Jacobian of the photometric potentials of a features set and saliency-driven selection of the features (highest Jacobian norms, stratified by Jacobian direction)
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef MPPFeatures_h
+#define MPPFeatures_h
+
+#include <visp/vpHomogeneousMatrix.h>
+#include <visp/vpPoseVector.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//angular step (rad) of the numerical Jacobian of the features potentials
+#define JACOBIAN_STEP 1e-3
+
+/*!
+ * \fn template<typename FeaturesSetType> void featuresRotationJacobian(FeaturesSetType &fSet, bool *dofs, std::vector<double> &J)
+ * \brief Numerical Jacobian of the features potentials with respect to the three rotation angles (central differences of fSet.update), stored as 3 values per feature, zero for inactive dofs
+ *
+ * fSet is updated back to the identity pose before returning
+ */
+template<typename FeaturesSetType>
+void featuresRotationJacobian(FeaturesSetType &fSet, bool *dofs, std::vector<double> &J)
+{
+    unsigned int nbFeatures = fSet.set.size();
+    J.assign(3*nbFeatures, 0.);
+    vpPoseVector dr;
+    vpHomogeneousMatrix dM;
+    for(unsigned int k = 0 ; k < 3 ; k++)
+    {
+        if(!dofs[3+k])
+            continue;
+        for(int sign = 1 ; sign >= -1 ; sign -= 2)
+        {
+            dr.set(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+            dr[3+k] = sign*JACOBIAN_STEP;
+            dM.buildFrom(dr);
+            fSet.update(dM);
+            for(unsigned int i = 0 ; i < nbFeatures ; i++)
+                J[3*i+k] += sign*fSet.set[i].getGMS()/(2.*JACOBIAN_STEP);
+        }
+    }
+    dM.eye();
+    fSet.update(dM);
+}
+
+/*!
+ * \fn template<typename FeaturesSetType> void selectSalientFeatures(FeaturesSetType &fSet, bool *dofs, double featuresSelection, std::vector<unsigned int> &selected)
+ * \brief Selects the features of highest rotation Jacobian norm
+ *
+ * Features are stratified with respect to their Jacobian direction (one stratum per signed dominant rotation axis), every stratum receiving the same share of the selection, so that every rotation axis remains constrained. The share left by poorly filled strata goes to the remaining features of highest norm.
+ * \param featuresSelection the ratio of features to keep if lower than 1, the number of features to keep otherwise
+ * \param selected the indices of the selected features, in increasing order
+ */
+template<typename FeaturesSetType>
+void selectSalientFeatures(FeaturesSetType &fSet, bool *dofs, double featuresSelection, std::vector<unsigned int> &selected)
+{
+    unsigned int nbFeatures = fSet.set.size();
+    unsigned int nbSelected = (featuresSelection < 1.) ? (unsigned int)(featuresSelection*nbFeatures) : (unsigned int)featuresSelection;
+    selected.clear();
+    if(nbSelected >= nbFeatures)
+    {
+        for(unsigned int i = 0 ; i < nbFeatures ; i++)
+            selected.push_back(i);
+        return;
+    }
+    
+    std::vector<double> J;
+    featuresRotationJacobian(fSet, dofs, J);
+    
+    //features sorted by decreasing Jacobian norm, within each stratum
+    std::vector<double> norm2(nbFeatures);
+    std::vector<std::vector<unsigned int> > strata(6);
+    for(unsigned int i = 0 ; i < nbFeatures ; i++)
+    {
+        double *Ji = &J[3*i];
+        norm2[i] = Ji[0]*Ji[0] + Ji[1]*Ji[1] + Ji[2]*Ji[2];
+        unsigned int kMax = 0;
+        for(unsigned int k = 1 ; k < 3 ; k++)
+            if(fabs(Ji[k]) > fabs(Ji[kMax]))
+                kMax = k;
+        strata[2*kMax + ((Ji[kMax] < 0.)?1:0)].push_back(i);
+    }
+    for(unsigned int st = 0 ; st < strata.size() ; st++)
+        std::stable_sort(strata[st].begin(), strata[st].end(), [&norm2](unsigned int a, unsigned int b) { return norm2[a] > norm2[b]; });
+    
+    std::vector<bool> isSelected(nbFeatures, false);
+    unsigned int quota = nbSelected / strata.size();
+    for(unsigned int st = 0 ; st < strata.size() ; st++)
+        for(unsigned int j = 0 ; (j < quota) && (j < strata[st].size()) ; j++)
+        {
+            isSelected[strata[st][j]] = true;
+            selected.push_back(strata[st][j]);
+        }
+    
+    if(selected.size() < nbSelected)
+    {
+        std::vector<unsigned int> remaining;
+        for(unsigned int i = 0 ; i < nbFeatures ; i++)
+            if(!isSelected[i])
+                remaining.push_back(i);
+        std::stable_sort(remaining.begin(), remaining.end(), [&norm2](unsigned int a, unsigned int b) { return norm2[a] > norm2[b]; });
+        for(unsigned int j = 0 ; selected.size() < nbSelected ; j++)
+            selected.push_back(remaining[j]);
+    }
+    
+    std::sort(selected.begin(), selected.end());
+}
+
+/*!
+ * \fn template<typename FeaturesSetType> void filterFeatures(FeaturesSetType &fSet, const std::vector<unsigned int> &selected)
+ * \brief Keeps only the selected features (indices in increasing order) of fSet
+ */
+template<typename FeaturesSetType>
+void filterFeatures(FeaturesSetType &fSet, const std::vector<unsigned int> &selected)
+{
+    for(unsigned int i = 0 ; i < selected.size() ; i++)
+        if(selected[i] != i)
+            fSet.set[i] = fSet.set[selected[i]];
+    fSet.set.erase(fSet.set.begin() + selected.size(), fSet.set.end());
+}
+
+/*!
+ * \fn template<typename FeaturesSetType> void selectFeatures(const FeaturesSetType &fSet, const std::vector<unsigned int> &selected, FeaturesSetType &fSet_sel)
+ * \brief Copies the selected features of fSet to fSet_sel, whose features buffer is reused from one call to another (fSet_sel is a full copy of a features set of the same kind, e.g. made once at the first image)
+ */
+template<typename FeaturesSetType>
+void selectFeatures(const FeaturesSetType &fSet, const std::vector<unsigned int> &selected, FeaturesSetType &fSet_sel)
+{
+    fSet_sel.set.resize(selected.size());
+    for(unsigned int i = 0 ; i < selected.size() ; i++)
+        fSet_sel.set[i] = fSet.set[selected[i]];
+}
+
+#endif //MPPFeatures_h
@@ -0,0 +1,407 @@
+/*!
+ \file MPPGyroIC.h
+ \brief Inverse compositional Gauss-Newton minimization of the MPP-SSD over the rotation, with a request Jacobian and Gauss-Newton matrix computed once per request features set, and its ESM variant
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef MPPGyroIC_h
+#define MPPGyroIC_h
+
+#include <visp/vpHomogeneousMatrix.h>
+#include <visp/vpPoseVector.h>
+#include <visp/vpTime.h>
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "MPPSSDgyro.h"
+#include "MPPSSDkernels.h"
+#include "MPPFeatures.h"
+
+//inverse-compositional and ESM laws: maximum number of iterations and convergence threshold on the norm of the rotation increment (rad)
+#define IC_MAX_ITERATIONS 50
+#define IC_CONVERGENCE 1e-6
+
+//inertial rate prior: weight of the prior term of the inverse compositional and ESM laws, relative to the mean diagonal term of the Gauss-Newton matrix
+#define IMU_PRIOR_WEIGHT 0.01
+
+/*!
+ * \class MPPGyroIC
+ * \brief Inverse-compositional Gauss-Newton minimization of the MPP-SSD over the rotation, or its efficient second-order minimization (ESM) variant
+ *
+ * The desired features set is rotated onto the request one, so that the residuals Jacobian is the request features set one at identity:
+ * it is computed once per request features set (buildFrom) with the 3x3 Gauss-Newton matrix, every iteration reducing to one update of the desired features set, one residuals pass and a 3x3 product.
+ * Rotating the desired features set by M aligns it with the request one when the request features set rotated by M^-1 aligns with the desired one, hence r = M^-1.
+ *
+ * ESM (setESM) averages the request Jacobian with the desired features set one at the current estimate (numerical, 2 updates per active dof at every iteration):
+ * the second-order convergence needs fewer iterations for large rotations, every iteration being more expensive.
+ */
+class MPPGyroIC
+{
+public:
+    enum { CONVERGED, MAX_ITERATIONS, DEADLINE };
+    
+    MPPGyroIC() : esm(false), robust(false), floatSSD(false), prior(false), nbIterationsMax(IC_MAX_ITERATIONS), nbIterations(0)
+    {
+        for(unsigned int k = 0 ; k < 6 ; k++)
+            dofs[k] = true;
+    }
+    
+    void setdof(const bool *d)
+    {
+        for(unsigned int k = 0 ; k < 6 ; k++)
+            dofs[k] = d[k];
+    }
+    
+    void setESM(bool e) { esm = e; }
+    
+    /*!
+     * \fn void setRobust(bool r)
+     * \brief Iteratively reweighted least squares with Tukey weights, the residuals scale being estimated at the first iteration of every track call (the robust cost to decrease is then fixed)
+     */
+    void setRobust(bool r) { robust = r; }
+    
+    /*!
+     * \fn void setFloatSSD(bool f)
+     * \brief Residuals, MPP-SSD and gradient of the iterations in single precision (residualsFloat and dotFloat), the steps and the pose staying in double precision
+     */
+    void setFloatSSD(bool f) { floatSSD = f; }
+    
+    void setMaxIterations(unsigned int n) { nbIterationsMax = n; }
+    
+    /*!
+     * \fn void setPrior(const vpPoseVector *r_prior)
+     * \brief Adds to the cost minimized by track the weak prior term lambda |log(r r_prior^-1)|^2 over the active dofs (e.g. the inertial rates integration), lambda being IMU_PRIOR_WEIGHT times the mean diagonal term of the Gauss-Newton matrix
+     *
+     * r_prior NULL removes the prior. cost does not include it, so that the MPP-SSD of the images remain comparable.
+     */
+    void setPrior(const vpPoseVector *r_prior)
+    {
+        prior = (r_prior != NULL);
+        if(prior)
+            M_prior_inv.buildFrom(*r_prior);
+    }
+    
+    /*!
+     * \fn void buildFrom(MPPFeaturesSet &fSet_req)
+     * \brief Request features values, Jacobian and inverse Gauss-Newton matrix (identity for inactive dofs)
+     *
+     * They are read-only once built and shared by the copies of the estimator (one per thread), until the next buildFrom of each copy.
+     */
+    void buildFrom(MPPFeaturesSet &fSet_req)
+    {
+        std::shared_ptr<Reference> reference = std::make_shared<Reference>();
+        featuresRotationJacobian(fSet_req, dofs, reference->J);
+        unsigned int nbFeatures = fSet_req.set.size();
+        reference->s_req.resize(nbFeatures);
+        double H[9] = {0., 0., 0., 0., 0., 0., 0., 0., 0.};
+        for(unsigned int i = 0 ; i < nbFeatures ; i++)
+        {
+            reference->s_req[i] = fSet_req.set[i].getGMS();
+            const double *Ji = &reference->J[3*i];
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                for(unsigned int m = 0 ; m < 3 ; m++)
+                    H[3*k+m] += Ji[k]*Ji[m];
+        }
+        inverse(H, reference->Hi);
+        for(unsigned int k = 0 ; k < 9 ; k++)
+            reference->H[k] = H[k];
+        //single precision copies, the Jacobian by columns
+        reference->s_req_f.assign(reference->s_req.begin(), reference->s_req.end());
+        reference->J_f.resize(3*nbFeatures);
+        reference->JJ_f.resize(6*nbFeatures);
+        for(unsigned int i = 0 ; i < nbFeatures ; i++)
+        {
+            const double *Ji = &reference->J[3*i];
+            for(unsigned int k = 0, c = 0 ; k < 3 ; k++)
+            {
+                reference->J_f[k*nbFeatures+i] = Ji[k];
+                for(unsigned int m = k ; m < 3 ; m++, c++)
+                    reference->JJ_f[c*nbFeatures+i] = Ji[k]*Ji[m];
+            }
+        }
+        ref = reference;
+    }
+    
+    /*!
+     * \fn unsigned int track(MPPFeaturesSet &fSet_des, vpPoseVector &r, double deadline = 0.)
+     * \brief Estimates r from its initial value, stopping at convergence, after the maximum number of iterations (IC_MAX_ITERATIONS by default), when the MPP-SSD increases (the previous orientation is kept) or when the deadline (if not 0) is over
+     *
+     * fSet_des is updated back to the identity pose before returning
+     * \return CONVERGED, MAX_ITERATIONS or DEADLINE
+     */
+    unsigned int track(MPPFeaturesSet &fSet_des, vpPoseVector &r, double deadline = 0.)
+    {
+        const std::vector<double> &s_req = ref->s_req, &J = ref->J;
+        unsigned int nbFeatures = s_req.size(), status = MAX_ITERATIONS;
+        double errPrev = std::numeric_limits<double>::max();
+        dM.buildFrom(r);
+        dM.inverse(M);
+        
+        //prior weight and inverse of the Gauss-Newton matrix augmented by the prior
+        double lambda = 0.;
+        if(prior)
+        {
+            unsigned int nbDofs = 0;
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                if(dofs[3+k])
+                {
+                    lambda += ref->H[4*k];
+                    nbDofs++;
+                }
+            lambda = (nbDofs == 0) ? 0. : IMU_PRIOR_WEIGHT*lambda/nbDofs;
+            double H[9];
+            for(unsigned int k = 0 ; k < 9 ; k++)
+                H[k] = ref->H[k];
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                if(dofs[3+k])
+                    H[4*k] += lambda;
+            inverse(H, Hi_prior);
+        }
+        
+        for(nbIterations = 0 ; nbIterations < nbIterationsMax ; nbIterations++)
+        {
+            if((deadline > 0.) && (vpTime::measureTimeMs() > deadline))
+            {
+                status = DEADLINE;
+                break;
+            }
+            
+            fSet_des.update(M);
+            double g[3] = {0., 0., 0.}, err = 0.;
+            if(floatSSD)
+            {
+                featuresValues(fSet_des, s_des_f);
+                e_f.resize(nbFeatures);
+                err = residualsFloat(s_des_f.data(), ref->s_req_f.data(), nbFeatures, e_f.data());
+            }
+            else
+            {
+                e.resize(nbFeatures);
+                for(unsigned int i = 0 ; i < nbFeatures ; i++)
+                {
+                    e[i] = fSet_des.set[i].getGMS() - s_req[i];
+                    err += e[i]*e[i];
+                }
+            }
+            if(robust)
+            {
+                if(!floatSSD)
+                    e_f.assign(e.begin(), e.end());
+                w.resize(nbFeatures);
+                if(nbIterations == 0)
+                    scale = robustScale(e_f.data(), nbFeatures, buf);
+                err = tukeyWeights(e_f.data(), nbFeatures, scale, w.data());
+            }
+            //prior residual: the rotation M M_prior^-1 = r^-1 r_prior between the current estimate and the prior, which the step dw decreases to first order
+            double p[3] = {0., 0., 0.};
+            if(prior)
+            {
+                dr.buildFrom(M*M_prior_inv);
+                for(unsigned int k = 0 ; k < 3 ; k++)
+                    if(dofs[3+k])
+                    {
+                        p[k] = dr[3+k];
+                        err += lambda*p[k]*p[k];
+                    }
+            }
+            if(err > errPrev)
+            {
+                M = M_prev;
+                status = CONVERGED;
+                break;
+            }
+            errPrev = err;
+            M_prev = M;
+            
+            const double *Hinv = prior ? Hi_prior : ref->Hi;
+            if(esm || robust)
+            {
+                double H[9] = {0., 0., 0., 0., 0., 0., 0., 0., 0.};
+                if(esm)
+                {
+                    if(floatSSD)
+                        e.assign(e_f.begin(), e_f.end());
+                    //Jacobian of the desired features set at exp(-dw) M, the request one being its value at the optimum (with a minus sign), averaged
+                    currentJacobian(fSet_des);
+                    for(unsigned int i = 0 ; i < 3*nbFeatures ; i++)
+                        J_cur[i] = 0.5*(J[i] - J_cur[i]);
+                    //the Gauss-Newton matrix is weighted as well (upper triangle, then mirrored)
+                    for(unsigned int i = 0 ; i < nbFeatures ; i++)
+                    {
+                        const double *Ji = &J_cur[3*i];
+                        double wi = robust ? w[i] : 1.;
+                        for(unsigned int k = 0 ; k < 3 ; k++)
+                        {
+                            double wJ = wi*Ji[k];
+                            g[k] += wJ*e[i];
+                            for(unsigned int m = k ; m < 3 ; m++)
+                                H[3*k+m] += wJ*Ji[m];
+                        }
+                    }
+                }
+                else
+                {
+                    //robust inverse compositional: weighted gradient and Gauss-Newton matrix as single precision dot products of the weights with the Jacobian columns and their products (fixed Jacobian)
+                    we_f.resize(nbFeatures);
+                    for(unsigned int i = 0 ; i < nbFeatures ; i++)
+                        we_f[i] = w[i]*e_f[i];
+                    for(unsigned int k = 0, c = 0 ; k < 3 ; k++)
+                    {
+                        g[k] = dotFloat(&ref->J_f[k*nbFeatures], we_f.data(), nbFeatures);
+                        for(unsigned int m = k ; m < 3 ; m++, c++)
+                            H[3*k+m] = dotFloat(&ref->JJ_f[c*nbFeatures], w.data(), nbFeatures);
+                    }
+                }
+                for(unsigned int k = 0 ; k < 3 ; k++)
+                    for(unsigned int m = 0 ; m < k ; m++)
+                        H[3*k+m] = H[3*m+k];
+                for(unsigned int k = 0 ; k < 3 ; k++)
+                    if(!dofs[3+k])
+                        H[4*k] = 1.;
+                    else
+                        H[4*k] += lambda;
+                inverse(H, Hi_cur);
+                Hinv = Hi_cur;
+            }
+            else if(floatSSD)
+            {
+                for(unsigned int k = 0 ; k < 3 ; k++)
+                    g[k] = dotFloat(&ref->J_f[k*nbFeatures], e_f.data(), nbFeatures);
+            }
+            else
+            {
+                for(unsigned int i = 0 ; i < nbFeatures ; i++)
+                {
+                    const double *Ji = &J[3*i];
+                    g[0] += Ji[0]*e[i];
+                    g[1] += Ji[1]*e[i];
+                    g[2] += Ji[2]*e[i];
+                }
+            }
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                g[k] += lambda*p[k];
+            
+            //the desired features set matches the request one rotated by exp(dw): M <- exp(dw)^-1 M
+            dr.set(0.0, 0.0, 0.0, Hinv[0]*g[0]+Hinv[1]*g[1]+Hinv[2]*g[2], Hinv[3]*g[0]+Hinv[4]*g[1]+Hinv[5]*g[2], Hinv[6]*g[0]+Hinv[7]*g[1]+Hinv[8]*g[2]);
+            dM.buildFrom(dr);
+            dM.inverse(dMi);
+            M = dMi*M;
+            
+            if(sqrt(dr[3]*dr[3] + dr[4]*dr[4] + dr[5]*dr[5]) < IC_CONVERGENCE)
+            {
+                nbIterations++;
+                status = CONVERGED;
+                break;
+            }
+        }
+        
+        dM.eye();
+        fSet_des.update(dM);
+        M.inverse(dM);
+        r.buildFrom(dM);
+        return status;
+    }
+    
+    unsigned int getNbIterations() const { return nbIterations; }
+    
+    /*!
+     * \fn double cost(MPPFeaturesSet &fSet_des, const vpPoseVector &r)
+     * \brief Cost minimized by track at r: SSD of the residuals, or their Tukey robust cost (scale estimated from these residuals) if robust
+     *
+     * fSet_des is updated back to the identity pose before returning
+     */
+    double cost(MPPFeaturesSet &fSet_des, const vpPoseVector &r)
+    {
+        const std::vector<double> &s_req = ref->s_req;
+        unsigned int nbFeatures = s_req.size();
+        dM.buildFrom(r);
+        dM.inverse(M);
+        fSet_des.update(M);
+        double err = 0.;
+        e_f.resize(nbFeatures);
+        for(unsigned int i = 0 ; i < nbFeatures ; i++)
+        {
+            e_f[i] = fSet_des.set[i].getGMS() - s_req[i];
+            err += e_f[i]*e_f[i];
+        }
+        if(robust)
+        {
+            w.resize(nbFeatures);
+            err = tukeyWeights(e_f.data(), nbFeatures, robustScale(e_f.data(), nbFeatures, buf), w.data());
+        }
+        dM.eye();
+        fSet_des.update(dM);
+        return err;
+    }
+    
+private:
+    /*!
+     * \fn void currentJacobian(MPPFeaturesSet &fSet_des)
+     * \brief Numerical Jacobian of the desired features values at exp(-dw) M with respect to dw (central differences), in J_cur
+     */
+    void currentJacobian(MPPFeaturesSet &fSet_des)
+    {
+        unsigned int nbFeatures = fSet_des.set.size();
+        J_cur.assign(3*nbFeatures, 0.);
+        for(unsigned int k = 0 ; k < 3 ; k++)
+        {
+            if(!dofs[3+k])
+                continue;
+            for(int sign = 1 ; sign >= -1 ; sign -= 2)
+            {
+                dr.set(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+                dr[3+k] = -sign*JACOBIAN_STEP;
+                dM.buildFrom(dr);
+                dMi = dM*M;
+                fSet_des.update(dMi);
+                for(unsigned int i = 0 ; i < nbFeatures ; i++)
+                    J_cur[3*i+k] += sign*fSet_des.set[i].getGMS()/(2.*JACOBIAN_STEP);
+            }
+        }
+    }
+    
+    static void inverse(const double *H, double *Hi)
+    {
+        double det = H[0]*(H[4]*H[8]-H[5]*H[7]) - H[1]*(H[3]*H[8]-H[5]*H[6]) + H[2]*(H[3]*H[7]-H[4]*H[6]);
+        //no constraint left (e.g. every residual rejected by the M-estimator): no step
+        if(fabs(det) < std::numeric_limits<double>::min())
+        {
+            for(unsigned int k = 0 ; k < 9 ; k++)
+                Hi[k] = 0.;
+            return;
+        }
+        Hi[0] = (H[4]*H[8]-H[5]*H[7])/det; Hi[1] = (H[2]*H[7]-H[1]*H[8])/det; Hi[2] = (H[1]*H[5]-H[2]*H[4])/det;
+        Hi[3] = (H[5]*H[6]-H[3]*H[8])/det; Hi[4] = (H[0]*H[8]-H[2]*H[6])/det; Hi[5] = (H[2]*H[3]-H[0]*H[5])/det;
+        Hi[6] = (H[3]*H[7]-H[4]*H[6])/det; Hi[7] = (H[1]*H[6]-H[0]*H[7])/det; Hi[8] = (H[0]*H[4]-H[1]*H[3])/det;
+    }
+    
+    /*!
+     * \struct Reference
+     * \brief Request features values, Jacobian (3 per feature, row major), Gauss-Newton matrix and its inverse, and the single precision values, Jacobian (3 columns of one value per feature)
+     * and Jacobian products of the Gauss-Newton matrix upper triangle (6 columns: J0 J0, J0 J1, J0 J2, J1 J1, J1 J2, J2 J2)
+     */
+    struct Reference
+    {
+        std::vector<double> s_req, J;
+        std::vector<float> s_req_f, J_f, JJ_f;
+        double H[9], Hi[9];
+    };
+    
+    bool dofs[6], esm, robust, floatSSD, prior;
+    std::shared_ptr<const Reference> ref;
+    std::vector<double> J_cur, e;
+    std::vector<float> e_f, s_des_f, w, we_f, buf;
+    float scale;
+    double Hi_cur[9], Hi_prior[9];
+    unsigned int nbIterationsMax, nbIterations;
+    vpHomogeneousMatrix M, M_prev, dM, dMi, M_prior_inv;
+    vpPoseVector dr;
+};
+
+#endif //MPPGyroIC_h
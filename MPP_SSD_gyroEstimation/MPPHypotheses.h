@@ -0,0 +1,303 @@
+/*!
+ \file MPPHypotheses.h
+ \brief Initial orientation guesses evaluated in parallel (best of a set of guesses, uniform SO(3) guesses refined coarse-to-fine with pruning) and parallel refinement of the orientation hypotheses kept from one image to the next
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef MPPHypotheses_h
+#define MPPHypotheses_h
+
+#include <visp/vpHomogeneousMatrix.h>
+#include <visp/vpPoseVector.h>
+#include <visp/vpTime.h>
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "MPPSSDgyro.h"
+#include "MPPSSDkernels.h"
+#include "MPPGyroIC.h"
+#include "ThreadPool.h"
+
+//application buffers scope of the allocations count (COUNT_ALLOCATIONS of MPPSSDgyroEstim.cpp), empty otherwise
+#ifndef APPLICATION_BUFFERS
+#define APPLICATION_BUFFERS
+#endif
+
+//single precision initial guesses checked in double precision (CHECK_FLOAT_SSD): maximum angle (deg) between the selected guesses
+#define FLOAT_SSD_TOLERANCE 0.01
+
+//multi-hypothesis tracking: maximum number of iterations of the refinement of every hypothesis and minimum angle (rad) between two kept hypotheses
+#define MH_MAX_ITERATIONS 10
+#define MH_MIN_ANGLE 0.02
+
+//uniform SO(3) initial guesses: relative cost margin over the best guess beyond which guesses are pruned, maximum number of guesses kept, number of coarse-to-fine refinement levels
+#define SO3_PRUNING_MARGIN 0.1
+#define SO3_MAX_HYPOTHESES 8
+#define SO3_REFINEMENT_LEVELS 3
+
+/*!
+ * \struct HypothesesContext
+ * \brief Per thread copy of the request features set and single precision buffer to evaluate initial orientation guesses
+ */
+struct HypothesesContext
+{
+    HypothesesContext() : fSet_req_version(-1) {}
+    
+    MPPFeaturesSet fSet_req;
+    long fSet_req_version; //version of the request features set fSet_req is a copy of
+    std::vector<float> s_req_f, e_f, w_f, buf_f;
+    std::vector<double> errTries; //MPP-SSD of the guesses of a call, in the context of the calling thread only
+    vpHomogeneousMatrix dMc;
+};
+
+#ifdef CHECK_FLOAT_SSD
+//number of initial guesses selections checked against the double precision MPP-SSD, and of the ones selecting a different guess
+static unsigned int nbFloatSSDChecks = 0, nbFloatSSDFailures = 0;
+#endif
+
+/*!
+ * \fn double hypothesisCost(HypothesesContext &ctx, const vpPoseVector &r, MPPFeaturesSet &fSet_des, const std::vector<float> &s_des_f, bool robust, bool floatSSD)
+ * \brief MPP-SSD of the context request features set rotated by r with respect to the desired one
+ */
+inline double hypothesisCost(HypothesesContext &ctx, const vpPoseVector &r, MPPFeaturesSet &fSet_des, const std::vector<float> &s_des_f, bool robust, bool floatSSD)
+{
+    ctx.dMc.buildFrom(r);
+    ctx.fSet_req.update(ctx.dMc);
+    
+    if(floatSSD)
+    {
+        double err0;
+        {
+            APPLICATION_BUFFERS;
+            featuresValues(ctx.fSet_req, ctx.s_req_f);
+            if(robust)
+            {
+                //Tukey robust cost of the residuals
+                unsigned int n = ctx.s_req_f.size();
+                ctx.e_f.resize(n);
+                ctx.w_f.resize(n);
+                for(unsigned int i = 0 ; i < n ; i++)
+                    ctx.e_f[i] = ctx.s_req_f[i] - s_des_f[i];
+                err0 = tukeyWeights(ctx.e_f.data(), n, robustScale(ctx.e_f.data(), n, ctx.buf_f), ctx.w_f.data());
+            }
+            else
+                err0 = ssdFloat(ctx.s_req_f.data(), s_des_f.data(), ctx.s_req_f.size());
+        }
+#ifdef CHECK_FLOAT_SSD
+        prSSDCmp<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec> > errorComputer(ctx.fSet_req, fSet_des, robust);
+        prPhotometricGMS<prCartesian3DPointVec> GS_error = errorComputer.getRobustCost();
+        std::cout << "try " << r.t() << " float SSD : " << err0 << " prSSDCmp : " << GS_error.getGMS() << std::endl;
+#endif
+        return err0;
+    }
+    
+    prSSDCmp<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec> > errorComputer(ctx.fSet_req, fSet_des, robust);
+    prPhotometricGMS<prCartesian3DPointVec> GS_error = errorComputer.getRobustCost();
+    return GS_error.getGMS();
+}
+
+/*!
+ * \fn vpPoseVector bestHypothesis(ThreadPool &pool, const std::vector<vpPoseVector> &v_r, const MPPFeaturesSet &fSet_req, long fSet_req_version, MPPFeaturesSet &fSet_des, std::vector<float> &s_des_f, std::vector<HypothesesContext> &ctx, bool robust, bool floatSSD, std::vector<double> *v_err = NULL, double deadline = 0.)
+ * \brief Evaluates the orientation guesses v_r in parallel and returns the one of lowest MPP-SSD (the first one in v_r order in case of equality, whatever the number of threads)
+ *
+ * Every thread evaluates the guesses on its own copy of the request features set, refreshed only when the version of fSet_req changes
+ * \param s_des_f buffer of the desired features values
+ * \param ctx per thread contexts, resized to the pool size
+ * \param v_err if not NULL, receives the MPP-SSD of every guess (swapped with the buffer of ctx[0])
+ * \param deadline if not 0, the guesses (but the first one) whose evaluation would start after this time (vpTime::measureTimeMs) are skipped, their MPP-SSD being set to the maximum double value
+ */
+inline vpPoseVector bestHypothesis(ThreadPool &pool, const std::vector<vpPoseVector> &v_r, const MPPFeaturesSet &fSet_req, long fSet_req_version, MPPFeaturesSet &fSet_des, std::vector<float> &s_des_f, std::vector<HypothesesContext> &ctx, bool robust, bool floatSSD, std::vector<double> *v_err = NULL, double deadline = 0.)
+{
+    if(floatSSD)
+    {
+        APPLICATION_BUFFERS;
+        featuresValues(fSet_des, s_des_f);
+    }
+    
+    if(ctx.size() != pool.size())
+        ctx.resize(pool.size());
+    std::vector<double> &errTries = ctx[0].errTries;
+    errTries.resize(v_r.size());
+    pool.parallelFor(v_r.size(), [&](unsigned int i, unsigned int t)
+    {
+        if((deadline > 0.) && (i > 0) && (vpTime::measureTimeMs() > deadline))
+        {
+            errTries[i] = std::numeric_limits<double>::max();
+            return;
+        }
+        if(ctx[t].fSet_req_version != fSet_req_version)
+        {
+            ctx[t].fSet_req = fSet_req;
+            ctx[t].fSet_req_version = fSet_req_version;
+        }
+        errTries[i] = hypothesisCost(ctx[t], v_r[i], fSet_des, s_des_f, robust, floatSSD);
+    });
+    
+    unsigned int iBest = 0;
+    for(unsigned int i = 1 ; i < errTries.size() ; i++)
+        if(errTries[i] < errTries[iBest])
+            iBest = i;
+#ifdef CHECK_FLOAT_SSD
+    //the same guesses, evaluated in double precision (no deadline), must select the same orientation
+    if(floatSSD)
+    {
+        std::vector<double> errTriesFloat(errTries); //the double precision call reuses the buffer of ctx[0]
+        vpPoseVector r_double = bestHypothesis(pool, v_r, fSet_req, fSet_req_version, fSet_des, s_des_f, ctx, robust, false);
+        errTries.swap(errTriesFloat);
+        vpThetaUVector tu = (vpHomogeneousMatrix(r_double).inverse()*vpHomogeneousMatrix(v_r[iBest])).getRotationMatrix().getThetaUVector();
+        double angle = sqrt(tu[0]*tu[0] + tu[1]*tu[1] + tu[2]*tu[2])*180.0/M_PI;
+        nbFloatSSDChecks++;
+        if(angle > FLOAT_SSD_TOLERANCE)
+        {
+            nbFloatSSDFailures++;
+            std::cout << "float SSD check failed: single precision guess " << v_r[iBest].t() << " double precision guess " << r_double.t() << " (" << angle << " deg)" << std::endl;
+        }
+    }
+#endif
+    if(v_err != NULL)
+        v_err->swap(errTries);
+    return v_r[iBest];
+}
+
+/*!
+ * \fn void so3UniformSamples(unsigned int n, std::vector<vpPoseVector> &v_r)
+ * \brief n rotations uniformly spread over SO(3) thanks to super-Fibonacci spirals of unit quaternions (Alexa, CVPR 2022)
+ */
+inline void so3UniformSamples(unsigned int n, std::vector<vpPoseVector> &v_r)
+{
+    const double phi = sqrt(2.), psi = 1.533751168755204288118041;
+    v_r.resize(n);
+    for(unsigned int i = 0 ; i < n ; i++)
+    {
+        double si = i+0.5;
+        double rho = sqrt(si/n), Rho = sqrt(1.-si/n);
+        double alpha = 2.*M_PI*si/phi, beta = 2.*M_PI*si/psi;
+        //quaternion (qx, qy, qz, qw) to theta u, with qw >= 0 so that theta is in [0, pi]
+        double q[4] = {rho*sin(alpha), rho*cos(alpha), Rho*sin(beta), Rho*cos(beta)};
+        if(q[3] < 0.)
+            for(unsigned int k = 0 ; k < 4 ; k++)
+                q[k] = -q[k];
+        double sinHalfTheta = sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2]);
+        double theta = 2.*atan2(sinHalfTheta, q[3]);
+        double scale = (sinHalfTheta > 1e-12) ? theta/sinHalfTheta : 2.;
+        v_r[i].set(0.0, 0.0, 0.0, scale*q[0], scale*q[1], scale*q[2]);
+    }
+}
+
+/*!
+ * \fn vpPoseVector so3HierarchicalSearch(ThreadPool &pool, unsigned int nbSamples, const MPPFeaturesSet &fSet_req, long fSet_req_version, MPPFeaturesSet &fSet_des, std::vector<float> &s_des_f, std::vector<HypothesesContext> &ctx, bool robust, bool floatSSD, double deadline = 0.)
+ * \brief Global 3 DOFs initial orientation guess: nbSamples uniform SO(3) guesses refined coarse-to-fine
+ *
+ * At every level, guesses whose MPP-SSD exceeds the best one by more than SO3_PRUNING_MARGIN are pruned (SO3_MAX_HYPOTHESES at most are kept), then the remaining ones are perturbed around the 3 rotation axes by half the angular step of the previous level.
+ * No refinement level starts after the deadline (if not 0).
+ */
+inline vpPoseVector so3HierarchicalSearch(ThreadPool &pool, unsigned int nbSamples, const MPPFeaturesSet &fSet_req, long fSet_req_version, MPPFeaturesSet &fSet_des, std::vector<float> &s_des_f, std::vector<HypothesesContext> &ctx, bool robust, bool floatSSD, double deadline = 0.)
+{
+    std::vector<vpPoseVector> v_r, v_r_kept;
+    std::vector<double> v_err, v_err_kept;
+    so3UniformSamples(nbSamples, v_r);
+    //covering radius of nbSamples cells of the 8 pi^2 volume of SO(3)
+    double step = pow(6.*M_PI/nbSamples, 1./3.);
+    vpHomogeneousMatrix M, dM;
+    vpPoseVector dr;
+    
+    for(unsigned int level = 0 ; level <= SO3_REFINEMENT_LEVELS ; level++)
+    {
+        bestHypothesis(pool, v_r, fSet_req, fSet_req_version, fSet_des, s_des_f, ctx, robust, floatSSD, &v_err, deadline);
+        
+        //the previous level kept guesses compete with their perturbations
+        v_r.insert(v_r.end(), v_r_kept.begin(), v_r_kept.end());
+        v_err.insert(v_err.end(), v_err_kept.begin(), v_err_kept.end());
+        std::vector<unsigned int> order(v_r.size());
+        for(unsigned int i = 0 ; i < order.size() ; i++)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&v_err](unsigned int a, unsigned int b) { return v_err[a] < v_err[b]; });
+        
+        v_r_kept.clear();
+        v_err_kept.clear();
+        double errMax = v_err[order[0]]*(1.+SO3_PRUNING_MARGIN);
+        for(unsigned int i = 0 ; (i < order.size()) && (v_r_kept.size() < SO3_MAX_HYPOTHESES) && (v_err[order[i]] <= errMax) ; i++)
+        {
+            v_r_kept.push_back(v_r[order[i]]);
+            v_err_kept.push_back(v_err[order[i]]);
+        }
+        
+        if((level == SO3_REFINEMENT_LEVELS) || ((deadline > 0.) && (vpTime::measureTimeMs() > deadline)))
+            break;
+        
+        step *= 0.5;
+        v_r.clear();
+        for(unsigned int h = 0 ; h < v_r_kept.size() ; h++)
+        {
+            M.buildFrom(v_r_kept[h]);
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                for(int sign = -1 ; sign <= 1 ; sign += 2)
+                {
+                    dr.set(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+                    dr[3+k] = sign*step;
+                    dM.buildFrom(dr);
+                    v_r.push_back(vpPoseVector(M*dM));
+                }
+        }
+    }
+    
+    return v_r_kept[0];
+}
+
+/*!
+ * \struct HypothesisRefinement
+ * \brief Per thread context of the multi-hypothesis refinement: copies of the estimator (refreshed when the request features set changes) and of the desired features set (refreshed at every image)
+ */
+struct HypothesisRefinement
+{
+    HypothesisRefinement() : icGyro_version(-1), fSet_des_version(-1) {}
+    
+    MPPGyroIC icGyro;
+    long icGyro_version;
+    MPPFeaturesSet fSet_des;
+    long fSet_des_version;
+};
+
+/*!
+ * \fn unsigned int refineHypotheses(ThreadPool &pool, std::vector<vpPoseVector> &v_r, std::vector<double> &v_err, const MPPGyroIC &icGyro, long fSet_req_version, const MPPFeaturesSet &fSet_des, long fSet_des_version, std::vector<HypothesisRefinement> &ctx, double deadline = 0.)
+ * \brief Refines the orientation hypotheses v_r in parallel, MH_MAX_ITERATIONS iterations at most, and returns the index of the one of lowest cost (the first one in case of equality, whatever the number of threads)
+ * \param v_err receives the cost of every refined hypothesis
+ * \param ctx per thread contexts, resized to the pool size
+ */
+inline unsigned int refineHypotheses(ThreadPool &pool, std::vector<vpPoseVector> &v_r, std::vector<double> &v_err, const MPPGyroIC &icGyro, long fSet_req_version, const MPPFeaturesSet &fSet_des, long fSet_des_version, std::vector<HypothesisRefinement> &ctx, double deadline = 0.)
+{
+    if(ctx.size() != pool.size())
+        ctx.resize(pool.size());
+    v_err.resize(v_r.size());
+    pool.parallelFor(v_r.size(), [&](unsigned int i, unsigned int t)
+    {
+        if(ctx[t].icGyro_version != fSet_req_version)
+        {
+            ctx[t].icGyro = icGyro;
+            ctx[t].icGyro.setMaxIterations(MH_MAX_ITERATIONS);
+            ctx[t].icGyro.setPrior(NULL);
+            ctx[t].icGyro_version = fSet_req_version;
+        }
+        if(ctx[t].fSet_des_version != fSet_des_version)
+        {
+            ctx[t].fSet_des = fSet_des;
+            ctx[t].fSet_des_version = fSet_des_version;
+        }
+        ctx[t].icGyro.track(ctx[t].fSet_des, v_r[i], deadline);
+        v_err[i] = ctx[t].icGyro.cost(ctx[t].fSet_des, v_r[i]);
+    });
+    
+    unsigned int iBest = 0;
+    for(unsigned int i = 1 ; i < v_err.size() ; i++)
+        if(v_err[i] < v_err[iBest])
+            iBest = i;
+    return iBest;
+}
+
+#endif //MPPHypotheses_h
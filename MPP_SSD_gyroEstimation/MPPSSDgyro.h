@@ -0,0 +1,294 @@
+/*!
+ \file MPPSSDgyro.h
+ \brief Mixture of Photometric Potentials (MPP) SSD spherical camera orientation estimation helpers shared by MPPSSDgyroEstim and MPPSSDbatch: features sets and estimator types, MPP-SSD,
+ * initial guesses grid, features sets of dual fisheye images and tracking of a sequence of images
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef MPPSSDgyro_h
+#define MPPSSDgyro_h
+
+#include <per/prStereoModel.h>
+
+#include <per/prStereoModelXML.h>
+#include <per/prRegularlySampledCSImage.h>
+
+#include <per/prPhotometricGMS.h>
+#include <per/prFeaturesSet.h>
+
+#include <per/prSSDCmp.h>
+
+#include <per/prPoseSphericalEstim.h>
+
+#include <visp/vpImage.h>
+
+#include <visp/vpTime.h>
+
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+typedef prFeaturesSet<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec>, prRegularlySampledCSImage > MPPFeaturesSet;
+typedef prPoseSphericalEstim<MPPFeaturesSet, prSSDCmp<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec> > > MPPGyro;
+
+/*!
+ * \fn double mppSSD(MPPFeaturesSet &fSet_req, MPPFeaturesSet &fSet_des, const vpPoseVector &r, bool robust)
+ * \brief MPP-SSD between the request features set rotated by r and the desired one, as returned by gyro.track
+ */
+inline double mppSSD(MPPFeaturesSet &fSet_req, MPPFeaturesSet &fSet_des, const vpPoseVector &r, bool robust)
+{
+    vpHomogeneousMatrix dMc(r);
+    fSet_req.update(dMc);
+    prSSDCmp<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec> > errorComputer(fSet_req, fSet_des, robust);
+    return errorComputer.getRobustCost().getGMS();
+}
+
+/*!
+ * \fn double mppSSDDesired(MPPFeaturesSet &fSet_req, MPPFeaturesSet &fSet_des, const vpPoseVector &r, bool robust)
+ * \brief MPP-SSD between the request features set and the desired one rotated by r^-1, the request features set being left untouched (it can be shared by threads) and the desired one being updated back to the identity pose
+ */
+inline double mppSSDDesired(MPPFeaturesSet &fSet_req, MPPFeaturesSet &fSet_des, const vpPoseVector &r, bool robust)
+{
+    vpHomogeneousMatrix dMc(r), cMd;
+    dMc.inverse(cMd);
+    fSet_des.update(cMd);
+    prSSDCmp<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec> > errorComputer(fSet_req, fSet_des, robust);
+    double err = errorComputer.getRobustCost().getGMS();
+    cMd.eye();
+    fSet_des.update(cMd);
+    return err;
+}
+
+/*!
+ * \fn void rotationGrid(unsigned int nbTries, const bool *dofs, std::vector<vpPoseVector> &v_r)
+ * \brief Initial guesses grid: nbTries angles 2 pi / nbTries apart about the first rotation axis (if active), the other active rotation axes getting the first angle of the grid (one try each)
+ */
+inline void rotationGrid(unsigned int nbTries, const bool *dofs, std::vector<vpPoseVector> &v_r)
+{
+    vpPoseVector r(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+    double angle[3]={0,0,0}, pasAngulaire;
+    pasAngulaire = 2.0*M_PI / nbTries;
+
+    unsigned int nbTriesPerDOF[3] = {1,1,1};
+    if(dofs[3])
+    {
+        nbTriesPerDOF[0] = nbTries;
+        angle[0] = -pasAngulaire*floor(nbTries*0.5);
+    }
+    if(dofs[4])
+    {
+        nbTriesPerDOF[1] = 1;//nbTries;
+        angle[1] = -pasAngulaire*floor(nbTries*0.5);
+    }
+    if(dofs[5])
+    {
+        nbTriesPerDOF[2] = 1;//nbTries;
+        angle[2] = -pasAngulaire*floor(nbTries*0.5);
+    }
+    v_r.clear();
+    for(int iTry0 = 0 ; iTry0 < nbTriesPerDOF[0] ; iTry0++, angle[0]+=pasAngulaire)
+    {
+        r[3] = angle[0];
+        if(dofs[4])
+            angle[1] = -pasAngulaire*floor(nbTries*0.5);
+        else
+            angle[1] = 0;
+        for(int iTry1 = 0 ; iTry1 < nbTriesPerDOF[1] ; iTry1++, angle[1]+=pasAngulaire)
+        {
+            r[4] = angle[1];
+            if(dofs[5])
+                angle[2] = -pasAngulaire*floor(nbTries*0.5);
+            else
+                angle[2] = 0;
+            for(int iTry2 = 0 ; iTry2 < nbTriesPerDOF[2] ; iTry2++, angle[2]+=pasAngulaire)
+            {
+                r[5] = angle[2];
+                v_r.push_back(r);
+            }
+        }
+    }
+}
+
+/*!
+ * \struct TwinOmniSampler
+ * \brief Per thread stereo rig model (loaded from its XML file), mask and spherical images, to build features sets from dual fisheye images concurrently with other threads
+ */
+struct TwinOmniSampler
+{
+    TwinOmniSampler(const char *stereoFile, const vpImage<unsigned char> &Mask_, unsigned int subdivLevel, float lambda_g)
+    : stereoCam(2), Mask(Mask_), IS(subdivLevel), GS(subdivLevel), GS_sample(lambda_g)
+    {
+        prStereoModelXML fromFile(stereoFile);
+        fromFile >> stereoCam;
+        IS.setInterpType(prInterpType::IMAGEPLANE_BILINEAR);
+    }
+    
+    //spherical images copied from already subdivided ones (of the same subdivision level)
+    TwinOmniSampler(const char *stereoFile, const vpImage<unsigned char> &Mask_, const prRegularlySampledCSImage<unsigned char> &IS_, const prRegularlySampledCSImage<float> &GS_, float lambda_g)
+    : stereoCam(2), Mask(Mask_), IS(IS_), GS(GS_), GS_sample(lambda_g)
+    {
+        prStereoModelXML fromFile(stereoFile);
+        fromFile >> stereoCam;
+    }
+    
+    /*!
+     * \fn void buildFrom(vpImage<unsigned char> &I, MPPFeaturesSet &fSet, bool poseJacobian)
+     * \brief Builds the features set (with or without its pose Jacobian) of the dual fisheye image I
+     */
+    void buildFrom(vpImage<unsigned char> &I, MPPFeaturesSet &fSet, bool poseJacobian)
+    {
+        IS.buildFromTwinOmni(I, stereoCam, &Mask);
+        IS.toAbsZN();
+        fSet.buildFrom(IS, GS, GS_sample, poseJacobian);
+    }
+    
+    prStereoModel stereoCam;
+    vpImage<unsigned char> Mask, I;
+    prRegularlySampledCSImage<unsigned char> IS;
+    prRegularlySampledCSImage<float> GS;
+    prPhotometricGMS<prCartesian3DPointVec> GS_sample;
+    
+private:
+    TwinOmniSampler(const TwinOmniSampler &);
+    TwinOmniSampler &operator=(const TwinOmniSampler &);
+};
+
+/*!
+ * \struct SequenceTrack
+ * \brief Images of a sequence (or of a segment of it) and their orientations, with respect to the first image of the sequence (local key image) or to the reference image
+ */
+struct SequenceTrack
+{
+    std::vector<unsigned int> v_imNum; //image numbers, the first one being the local key image of the sequence if there is no reference image
+    std::vector<vpPoseVector> v_pose;
+    std::vector<double> v_err, v_temps;
+    std::vector<unsigned int> v_keys; //indices in v_imNum of the images that became key images (odometry with key images only, the first image of the sequence excluded)
+};
+
+/*!
+ * \class MPPGyroRegistration
+ * \brief Registration of trackSequence with the Gauss-Newton law of prPoseSphericalEstim, the key image switching when the MPP-SSD is greater than seuilErr
+ */
+class MPPGyroRegistration
+{
+public:
+    MPPGyroRegistration(const bool *dofs, bool robust, double seuilErr) : robust(robust), seuilErr(seuilErr)
+    {
+        gyro.setdof(dofs[0], dofs[1], dofs[2], dofs[3], dofs[4], dofs[5]);
+    }
+    
+    //the pose Jacobian of the request features set is needed by the law
+    bool poseJacobian() const { return true; }
+    void buildFrom(MPPFeaturesSet &fSet_req) { gyro.buildFrom(fSet_req); }
+    double track(MPPFeaturesSet &, MPPFeaturesSet &fSet_des, vpPoseVector &r) { return gyro.track(fSet_des, r, 1.0, robust); }
+    bool keySwitch(double err, const vpPoseVector &) { return err > seuilErr; }
+    
+    MPPGyro gyro;
+    
+private:
+    bool robust;
+    double seuilErr;
+};
+
+/*!
+ * \fn template<typename Registration> void trackSequence(SequenceTrack &seq, vpImage<unsigned char> *I_ref, const std::function<std::shared_ptr<vpImage<unsigned char> >(unsigned int)> &frame, TwinOmniSampler &sampler, Registration &reg, unsigned int estimationType, const std::vector<vpPoseVector> &v_r_tries, bool robust)
+ * \brief Pure gyro (estimationType 0), odometry (estimationType 1) or odometry with key images (estimationType 2) of the images of seq, frame giving the image of an image number,
+ * with features sets of its own so that sequences can be tracked in parallel (every one with its own sampler and registration)
+ *
+ * The first image of the sequence is its local key image if I_ref is NULL, the reference image I_ref being the first key image otherwise.
+ * Every image is initialized with the orientation of the previous one (the identity for pure gyro, the initial guess of v_r_tries of lowest MPP-SSD if there are several), without pyramid.
+ * The registration provides poseJacobian() (whether its law needs the pose Jacobian of the request features set), buildFrom(fSet_req), track(fSet_req, fSet_des, r) (returning the MPP-SSD) and keySwitch(err, r).
+ */
+template<typename Registration>
+void trackSequence(SequenceTrack &seq, vpImage<unsigned char> *I_ref, const std::function<std::shared_ptr<vpImage<unsigned char> >(unsigned int)> &frame, TwinOmniSampler &sampler, Registration &reg, unsigned int estimationType, const std::vector<vpPoseVector> &v_r_tries, bool robust)
+{
+    MPPFeaturesSet fSet_buffers[2];
+    MPPFeaturesSet *fSet_req = &fSet_buffers[0], *fSet_des = &fSet_buffers[1];
+    
+    //the pose Jacobian of a desired features set is only needed once it becomes the request one
+    bool poseJacobianCompute = (estimationType == 1) && reg.poseJacobian();
+    
+    std::shared_ptr<vpImage<unsigned char> > I;
+    vpPoseVector r(0.0, 0.0, 0.0, 0.0, 0.0, 0.0), r_to_save;
+    vpHomogeneousMatrix key_dMc;
+    bool keySwitch = false;
+    double temps, err, errTry, errMin;
+    
+    seq.v_pose.clear();
+    seq.v_err.clear();
+    seq.v_temps.clear();
+    seq.v_keys.clear();
+    
+    //first key image
+    unsigned int i = 0;
+    temps = vpTime::measureTimeMs();
+    if(I_ref == NULL)
+    {
+        I = frame(seq.v_imNum[0]);
+        I_ref = I.get();
+        seq.v_pose.push_back(r);
+        seq.v_err.push_back(0.);
+        i++;
+    }
+    sampler.buildFrom(*I_ref, *fSet_req, reg.poseJacobian());
+    reg.buildFrom(*fSet_req);
+    if(i > 0)
+        seq.v_temps.push_back(vpTime::measureTimeMs()-temps);
+    
+    //the desired features set is the one of the previous image from the second tracked image on
+    for(unsigned int iFirst = i ; i < seq.v_imNum.size() ; i++)
+    {
+        temps = vpTime::measureTimeMs();
+        if(estimationType == 0)
+            r.set(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+        else if((i > iFirst) && ((estimationType == 1) || keySwitch))
+        {
+            key_dMc.buildFrom(r_to_save);
+            std::swap(fSet_req, fSet_des);
+            reg.buildFrom(*fSet_req);
+            if(estimationType == 2)
+                seq.v_keys.push_back(i-1);
+            r.set(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+        }
+        
+        I = frame(seq.v_imNum[i]);
+        sampler.buildFrom(*I, *fSet_des, poseJacobianCompute);
+        
+        //initial guesses grid of pure gyro, the one of lowest MPP-SSD being kept
+        if((estimationType == 0) && (v_r_tries.size() > 1))
+        {
+            errMin = std::numeric_limits<double>::max();
+            for(unsigned int k = 0 ; k < v_r_tries.size() ; k++)
+            {
+                errTry = mppSSD(*fSet_req, *fSet_des, v_r_tries[k], robust);
+                if(errTry < errMin)
+                {
+                    errMin = errTry;
+                    r = v_r_tries[k];
+                }
+            }
+        }
+        
+        err = reg.track(*fSet_req, *fSet_des, r);
+        
+        //the current desired features set will be the next key image: build it again with its pose Jacobian now, once
+        if(estimationType == 2)
+        {
+            keySwitch = reg.keySwitch(err, r);
+            if(keySwitch && reg.poseJacobian())
+                fSet_des->buildFrom(sampler.IS, sampler.GS, sampler.GS_sample, true); //eager build, from the spherical image of the current image
+        }
+        
+        r_to_save.buildFrom(vpHomogeneousMatrix(r)*key_dMc);
+        seq.v_pose.push_back(r_to_save);
+        seq.v_err.push_back(err);
+        seq.v_temps.push_back(vpTime::measureTimeMs()-temps);
+    }
+}
+
+#endif //MPPSSDgyro_h
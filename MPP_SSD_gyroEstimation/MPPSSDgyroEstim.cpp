@@ -7,15 +7,40 @@
  \param subDiv the number of subdivision levels for the spherical image sampling
  \param lambda_g the Gaussian expansion parameter
  \param imDir the directory containing the images to process
- \param iRef the reference image index (in the lexicographical order)
+ \param iRef the reference image index (in the lexicographical order), or a comma separated list of reference images indices to track every image against all of them in a single pass (pure gyro)
  \param i0 the first image index of the sequence to process
  \param i360 the last image index
  \param iStep the image sequence looping step
  \param Mask the image file of the mask (white pixels are to be considered whereas black pixels are not)
- \param nbTries the number of tested initial guesses for the optimization (the one leading to the lower MPP-SSD is kept)
+ \param nbTries the number of tested initial guesses for the optimization (the one leading to the lower MPP-SSD is kept), per DOF or over SO(3) depending on initType
  \param estimationType selects which estimation type to consider between 0 pure gyro, 1 incremental gyro, 2 incremental fyro with key images
  \param stabilization if 1, outputs the rotation compensated dualfisheye image
- \param ficPosesInit the text file of initial poses (one pose line per image to process)
+ \param ficPosesInit the text file of initial poses (one pose line per image to process), ignored if it does not exist
+ \param nbThreads the number of threads of the initial guesses evaluation (0, the default, for the number of cores)
+ \param deadline the processing time budget of every image in ms (0, the default, for no budget): once over, or expected to be over before the end of a gyro.track stage, the remaining initial guesses and tracking stages are skipped and the best orientation tracked so far is kept (the pose of the previous image if no tracking stage was done)
+ \param keyPolicy the key image switching policy of estimationType 2: 0 (the default) MPP-SSD greater than seuilErr, 1 adaptive (MPP-SSD, iterations and rotation from the key image)
+ \param seuilErr the MPP-SSD threshold of the key image switching (0.0325, the default, tuned for lambda_g 0.325 at subdivision level 3), the nominal scale of the adaptive threshold
+ \param imuFile the text (t wx wy wz lines) or binary (.bin, 4 doubles per sample) file of the gyroscope rates acquired with the images, ignored if it does not exist: their integration between two images is the initial orientation, and the prior of the inverse compositional and ESM laws
+ \param frameTimes the text file of the images acquisition times (image index and time lines), in the time base of imuFile
+ \param schedulePolicy the real-time scheduling of the images (0, the default, every image; 1 the latest arrived image, skipping the backlog; 2 step adapted to the latency), the images arriving at the frameTimes times or every FRAME_PERIOD ms
+ \param latencyTarget the end-to-end latency target of the adaptive step in ms (FRAME_PERIOD by default)
+ \param checkpointPeriod the number of processed images between two checkpoints of the sequential loop state (0, the default, for none), written asynchronously to checkpoint_iRef_i0_i360.bin
+ \param resume if 1, resumes from the checkpoint of the same configuration, if any (0 by default)
+ \param featuresSelection the saliency-driven features selection: 0 (the default) keeps all the features, ]0,1[ the ratio of features to keep, >= 1 the number of features to keep
+ \param nbPyramidLevels the number of subdivision levels of the tracking pyramid, coarsest first (1, the default, for none)
+ \param initType the initial guesses strategy: 0 (the default) nbTries guesses per rotation DOF, 1 nbTries uniform SO(3) guesses refined coarse-to-fine with pruning, 2 maxima of the SO(3) correlation of the spherical harmonics
+ \param predictorType the motion model of the initial guess: 0 (the default) none, 1 constant angular velocity, 2 constant angular acceleration, 3 exponentially smoothed angular velocity
+ \param optimLaw the optimization law: 0 (the default) Gauss-Newton of prPoseSphericalEstim, 1 inverse compositional, 2 ESM
+ \param nbHypotheses the number of orientation hypotheses kept from one image to the next (0, the default, for none)
+ \param keyDatabase if 1, the key images are stored and retrieved at revisits (estimationType 2, 0 by default)
+ \param rotationAveraging if 1, the key images rotations are refined by rotation averaging once the sequence is processed (estimationType 2, 0 by default)
+ \param segmentParallel if 1, the sequence is split into segments tracked in parallel (estimationType 1 and 2, 0 by default)
+ \param frameParallel if 1, the images are tracked in parallel against the reference (estimationType 0, 0 by default), the images whose file is missing being skipped (status 3 in status_iRef_i0_i360.txt)
+ \param floatSSD if 1, the MPP-SSD of the initial guesses, and the residuals, MPP-SSD and gradient of the inverse compositional and ESM iterations, are computed in single precision (0 by default)
+ \param robust if 1, the MPP-SSD is made robust to occlusions by the Tukey M-estimator, in every law and in the initial guesses (0 by default)
+ \param pyramidIterations the maximum number of iterations of the inverse compositional and ESM laws at every coarse level of the tracking pyramid (0, the default, for IC_MAX_ITERATIONS as at the finest level)
+ *
+ * ./MPPSSDgyroEstim --checks runs the behavior checks on synthetic data and returns the number of failed checks
  *
  \author Guillaume CARON
  \version 0.1
@@ -47,10 +72,829 @@
 
 #include <visp/vpDisplayX.h>
 
+#include <algorithm>
+#include <atomic>
+#include <complex>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+
+
 #define INTERPTYPE prInterpType::IMAGEPLANE_BILINEAR
 
 //#define VERBOSE
 
+//compares the single precision MPP-SSD to the prSSDCmp one for every initial guess, and the guess selected in single precision to the one selected in double precision (the program fails if they differ by more than FLOAT_SSD_TOLERANCE degrees)
+//#define CHECK_FLOAT_SSD
+
+//segment-parallel odometry: number of images tracked by two consecutive segments, to stitch them
+#define SEGMENT_OVERLAP 10
+
+//behavior checks (--checks): seed of the synthetic data, maximum error (rad) of the rotations averaged from noisy relative rotations with outliers
+#define CHECKS_SEED 12345u
+#define CHECKS_RA_TOLERANCE 0.01
+//behavior checks (--checks) of the features sets: subdivision level, Gaussian expansion parameter and rotation (rad) of the synthetic images
+#define CHECKS_SUBDIV_LEVEL 3
+#define CHECKS_LAMBDA_G 0.325f
+#define CHECKS_ROTATION 0.1
+//behavior checks (--checks) of the single precision kernels: maximum relative error of their sums
+#define CHECKS_FLOAT_RELATIVE 1e-6
+//behavior checks (--checks) of the M-estimator: ratio of outliers among the residuals, maximum relative error of their scale, number of tracks timed with and without the M-estimator
+#define CHECKS_OUTLIERS 0.1
+#define CHECKS_SCALE_TOLERANCE 0.2
+#define CHECKS_TIMING_TRACKS 20
+//behavior checks (--checks) of the inverse compositional and ESM laws: maximum angle (deg) between their orientation and the Gauss-Newton one of prPoseSphericalEstim
+#define CHECKS_LAW_TOLERANCE 0.2
+//behavior checks (--checks) of the thread pool: number of threads and of successive parallel loops
+#define CHECKS_POOL_THREADS 4
+#define CHECKS_POOL_CALLS 2000
+//behavior checks (--checks) of the real-time scheduling: period (ms) of the synthetic acquisition times and processing time (ms) of an image, slower than real time
+#define CHECKS_FRAME_PERIOD 5.
+#define CHECKS_PROCESSING_TIME 12.
+
+//counts the heap allocations (operator new, the matrices of ViSP being allocated by malloc are not counted) of the whole body of the sequential loop for every image, from the wait
+//of its arrival to its checkpoint, prints their steady state count, and checks that the application buffers (APPLICATION_BUFFERS scopes) do not allocate any more after the first image
+//#define COUNT_ALLOCATIONS
+
+#ifdef COUNT_ALLOCATIONS
+#include <new>
+#include <cstdlib>
+
+//heap allocations of the whole program (libPeR and ViSP included), and of the application buffers sections only
+std::atomic<unsigned long> nbAllocations(0), nbApplicationAllocations(0);
+thread_local unsigned int applicationBuffersDepth = 0;
+
+/*!
+ * \struct ApplicationBuffersScope
+ * \brief Counts the heap allocations of the current thread in nbApplicationAllocations as well, for its lifetime
+ */
+struct ApplicationBuffersScope
+{
+    ApplicationBuffersScope() { applicationBuffersDepth++; }
+    ~ApplicationBuffersScope() { applicationBuffersDepth--; }
+};
+#define APPLICATION_BUFFERS ApplicationBuffersScope applicationBuffersScope
+
+void *operator new(std::size_t size)
+{
+    nbAllocations++;
+    if(applicationBuffersDepth > 0)
+        nbApplicationAllocations++;
+    void *p = malloc(size ? size : 1);
+    if(p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+#else
+#define APPLICATION_BUFFERS
+#endif
+
+//the switches above (CHECK_FLOAT_SSD, COUNT_ALLOCATIONS) apply to the headers included below
+#include "MPPSSDgyro.h"
+#include "MPPSSDkernels.h"
+#include "MPPFeatures.h"
+#include "MPPGyroIC.h"
+#include "ThreadPool.h"
+#include "MPPHypotheses.h"
+#include "SO3Correlation.h"
+#include "KeyImages.h"
+#include "RotationAveraging.h"
+#include "ImuIntegrator.h"
+#include "FrameScheduler.h"
+#include "Checkpoint.h"
+#include "KeySwitchPolicy.h"
+#include "MotionPredictor.h"
+
+/*!
+ * \struct PoseRow
+ * \brief Pose vector printed on one line as r.t() is, without building the row vector (the per image traces of the sequential loop do not allocate)
+ */
+struct PoseRow
+{
+    const vpPoseVector &r;
+};
+
+std::ostream &operator<<(std::ostream &os, const PoseRow &p)
+{
+    for(unsigned int k = 0 ; k < 6 ; k++)
+        os << (k ? "  " : "") << p.r[k];
+    return os;
+}
+
+/*!
+ * \struct FrameWorker
+ * \brief Per thread context of the frame-parallel tracking against a fixed reference: sampler (image, stereo rig model, mask and spherical images), copy of the request features set (gyro.track updates it), desired features set and estimators,
+ * the reference data of the inverse compositional law being shared
+ */
+struct FrameWorker
+{
+    FrameWorker(const char *stereoFile, const vpImage<unsigned char> &Mask, unsigned int subdivLevel, float lambda_g) : sampler(stereoFile, Mask, subdivLevel, lambda_g)
+    {
+    }
+    
+    TwinOmniSampler sampler;
+    MPPFeaturesSet fSet_req, fSet_des;
+    MPPGyro gyro;
+    MPPGyroIC icGyro;
+};
+
+/*!
+ * \struct ReferenceTrack
+ * \brief Request features set, estimators and results of one of the references of the multi-reference tracking, the request features set and estimators being its own ones or, for the first reference, those of the sequential loop
+ */
+struct ReferenceTrack
+{
+    ReferenceTrack() : fSet_req(&fSet_own), gyro(&gyro_own), icGyro(&icGyro_own) {}
+    
+    unsigned int iRef;
+    MPPFeaturesSet fSet_own, *fSet_req;
+    MPPGyro gyro_own, *gyro;
+    MPPGyroIC icGyro_own, *icGyro;
+    std::vector<vpPoseVector> pv;
+    std::vector<double> err, v_temps;
+};
+
+/*!
+ * \struct PyramidLevel
+ * \brief Spherical images, double-buffered features sets and orientation estimator of a coarse subdivision level of the tracking pyramid
+ */
+struct PyramidLevel
+{
+    PyramidLevel(unsigned int subdivLevel)
+    : IS_req(subdivLevel), IS_des(subdivLevel), GS(subdivLevel), fSet_req(&fSet_buffers[0]), fSet_des(&fSet_buffers[1])
+    {
+        IS_req.setInterpType(INTERPTYPE);
+        IS_des.setInterpType(INTERPTYPE);
+    }
+    
+    prRegularlySampledCSImage<unsigned char> IS_req, IS_des;
+    prRegularlySampledCSImage<float> GS;
+    MPPFeaturesSet fSet_buffers[2];
+    MPPFeaturesSet *fSet_req, *fSet_des;
+    MPPGyro gyro;
+    MPPGyroIC icGyro;
+    
+private:
+    PyramidLevel(const PyramidLevel &);
+    PyramidLevel &operator=(const PyramidLevel &);
+};
+
+/*!
+ * \class SegmentRegistration
+ * \brief Registration of trackSequence for the segment-parallel odometry: Gauss-Newton law of prPoseSphericalEstim (optimLaw 0), inverse compositional or ESM law, and key image switching policy
+ */
+class SegmentRegistration
+{
+public:
+    SegmentRegistration(bool *dofs, unsigned int optimLaw, bool robust, bool floatSSD, unsigned int keyPolicy, double seuilErr) : optimLaw(optimLaw), robust(robust), keySwitchPolicy(keyPolicy, seuilErr)
+    {
+        gyro.setdof(dofs[0], dofs[1], dofs[2], dofs[3], dofs[4], dofs[5]);
+        icGyro.setdof(dofs);
+        icGyro.setESM(optimLaw == 2);
+        icGyro.setRobust(robust);
+        icGyro.setFloatSSD(floatSSD);
+    }
+    
+    bool poseJacobian() const { return optimLaw == 0; }
+    
+    void buildFrom(MPPFeaturesSet &fSet_req)
+    {
+        if(optimLaw == 0)
+            gyro.buildFrom(fSet_req);
+        else
+            icGyro.buildFrom(fSet_req);
+    }
+    
+    double track(MPPFeaturesSet &fSet_req, MPPFeaturesSet &fSet_des, vpPoseVector &r)
+    {
+        if(optimLaw == 0)
+            return gyro.track(fSet_des, r, 1.0, robust);
+        icGyro.track(fSet_des, r);
+        return mppSSD(fSet_req, fSet_des, r, robust);
+    }
+    
+    bool keySwitch(double err, const vpPoseVector &r)
+    {
+        return keySwitchPolicy.decide(err, (optimLaw == 0) ? 0 : icGyro.getNbIterations(), r);
+    }
+    
+private:
+    unsigned int optimLaw;
+    bool robust;
+    MPPGyro gyro;
+    MPPGyroIC icGyro;
+    KeySwitchPolicy keySwitchPolicy;
+};
+
+/*!
+ * \fn void renderBlobs(vpImage<unsigned char> &I, unsigned int height, const double *R)
+ * \brief Synthetic equirectangular image (height x 2 height pixels) of four Gaussian blobs on the sphere, rotated by R (row major): I(X) = f(R^T X), X being the direction of the pixel
+ * (row v at colatitude theta from the y axis, column u at longitude phi from the z axis)
+ */
+void renderBlobs(vpImage<unsigned char> &I, unsigned int height, const double *R)
+{
+    const double blobs[4][4] = {{1., 0.2, 0.3, 1.}, {-0.3, 1., 0.5, 2.}, {0.2, -0.4, -1., 3.}, {0.7, 0.7, -0.2, 4.}};
+    unsigned int width = 2*height;
+    I.resize(height, width);
+    for(unsigned int v = 0 ; v < height ; v++)
+        for(unsigned int u = 0 ; u < width ; u++)
+        {
+            double theta = M_PI*(1.-(v+0.5)/height), phi = 2.*M_PI*(u+0.5)/width - M_PI;
+            double X[3] = {sin(theta)*sin(phi), cos(theta), sin(theta)*cos(phi)}, f = 0.;
+            for(unsigned int b = 0 ; b < 4 ; b++)
+            {
+                double c = 0., n = 0.;
+                for(unsigned int k = 0 ; k < 3 ; k++)
+                {
+                    c += (R[k]*X[0] + R[3+k]*X[1] + R[6+k]*X[2])*blobs[b][k];
+                    n += blobs[b][k]*blobs[b][k];
+                }
+                f += blobs[b][3]*exp((c/sqrt(n) - 1.)/0.1);
+            }
+            I[v][u] = (unsigned char)std::min(255., 50.*f);
+        }
+}
+
+/*!
+ * \fn void syntheticFeaturesSets(const double *w, MPPFeaturesSet &fSet_req, MPPFeaturesSet &fSet_des, bool poseJacobian)
+ * \brief Features sets (CHECKS_SUBDIV_LEVEL, CHECKS_LAMBDA_G) of the blobs image and of a copy of it rotated by exp(w) (theta u, rad), the request one with its pose Jacobian if poseJacobian (gyro.track)
+ */
+void syntheticFeaturesSets(const double *w, MPPFeaturesSet &fSet_req, MPPFeaturesSet &fSet_des, bool poseJacobian)
+{
+    unsigned int ehaut = 4*SO3_FFT_BANDWIDTH, elarg = 2*ehaut;
+    double R[9], Id[9] = {1., 0., 0., 0., 1., 0., 0., 0., 1.};
+    rotationExp(w, R);
+    vpImage<unsigned char> I_a, I_b, Mask_eq(ehaut, elarg, 255);
+    renderBlobs(I_a, ehaut, Id);
+    renderBlobs(I_b, ehaut, R);
+    prEquirectangular ecam(elarg*0.5/M_PI, ehaut*0.5/(M_PI*0.5), elarg*0.5, ehaut*0.5);
+    prRegularlySampledCSImage<unsigned char> IS(CHECKS_SUBDIV_LEVEL);
+    IS.setInterpType(INTERPTYPE);
+    prRegularlySampledCSImage<float> GS(CHECKS_SUBDIV_LEVEL);
+    prPhotometricGMS<prCartesian3DPointVec> GS_sample(CHECKS_LAMBDA_G);
+    IS.buildFromEquiRect(I_a, ecam, &Mask_eq);
+    IS.toAbsZN();
+    fSet_req.buildFrom(IS, GS, GS_sample, poseJacobian);
+    IS.buildFromEquiRect(I_b, ecam, &Mask_eq);
+    IS.toAbsZN();
+    fSet_des.buildFrom(IS, GS, GS_sample, false);
+}
+
+/*!
+ * \fn int selfChecks()
+ * \brief Behavior checks of the application-side algorithms on synthetic data, without any image nor calibration (first argument --checks)
+ * \return the number of failed checks
+ */
+int selfChecks()
+{
+    int nbFailures = 0;
+    std::mt19937 gen(CHECKS_SEED);
+    std::normal_distribution<double> normal(0., 1.);
+    std::uniform_real_distribution<double> uniform(-1., 1.);
+    
+    //thread pool: CHECKS_POOL_CALLS successive parallel loops of 0 to 36 tasks, every task of a loop running exactly once, on a thread index lower than the pool size, and before the loop returns
+    //(a late task of a loop would find the tasks counters of the next one), the mean time of a loop being printed
+    {
+        ThreadPool pool(CHECKS_POOL_THREADS);
+        const unsigned int nbTasksMax = 37;
+        std::vector<std::atomic<unsigned int> > runs(nbTasksMax);
+        std::atomic<unsigned int> nbBadThreads(0);
+        unsigned int nbBadLoops = 0;
+        double t = vpTime::measureTimeMs();
+        for(unsigned int c = 0 ; c < CHECKS_POOL_CALLS ; c++)
+        {
+            unsigned int n = c % nbTasksMax;
+            for(unsigned int i = 0 ; i < nbTasksMax ; i++)
+                runs[i] = 0;
+            pool.parallelFor(n, [&](unsigned int i, unsigned int iThread)
+            {
+                if(iThread >= pool.size())
+                    nbBadThreads++;
+                runs[i]++;
+            });
+            bool ok = true;
+            for(unsigned int i = 0 ; i < nbTasksMax ; i++)
+                ok = ok && (runs[i] == ((i < n) ? 1u : 0u));
+            nbBadLoops += ok ? 0 : 1;
+        }
+        t = (vpTime::measureTimeMs() - t)/CHECKS_POOL_CALLS;
+        bool ok = (nbBadLoops == 0) && (nbBadThreads == 0) && (pool.size() == CHECKS_POOL_THREADS);
+        std::cout << "thread pool check " << (ok ? "passed" : "FAILED") << ": " << nbBadLoops << " of " << CHECKS_POOL_CALLS << " loops with a task not run exactly once, " << nbBadThreads << " tasks on a wrong thread index, " << t*1000. << " us per loop on " << pool.size() << " threads" << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    //rotation averaging: random rotations (the first one being the identity), relative rotations R_j R_i^T of every node to its RA_NB_NEIGHBOURS next ones perturbed by a 0.1 deg noise,
+    //a few of them by 30 deg (outliers), the rotations being initialized by composing the noisy relative rotations of consecutive nodes (odometry)
+    {
+        const unsigned int nbNodes = 30;
+        std::vector<double> R_true(9*nbNodes), R(9*nbNodes), w;
+        double v[3], N[9], E[9], P[9];
+        v[0] = v[1] = v[2] = 0.;
+        rotationExp(v, &R_true[0]);
+        for(unsigned int n = 1 ; n < nbNodes ; n++)
+        {
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                v[k] = 1.5*uniform(gen);
+            rotationExp(v, &R_true[9*n]);
+        }
+        std::vector<RotationEdge> edges;
+        RotationEdge edge;
+        for(unsigned int step = 1 ; step <= RA_NB_NEIGHBOURS ; step++)
+            for(unsigned int i = 0 ; i + step < nbNodes ; i++)
+            {
+                edge.i = i;
+                edge.j = i + step;
+                bool outlier = (step == 2) && (i % 7 == 3);
+                for(unsigned int k = 0 ; k < 3 ; k++)
+                    v[k] = outlier ? (M_PI/6.)/sqrt(3.) : normal(gen)*0.1*M_PI/180.;
+                rotationExp(v, N);
+                for(unsigned int k = 0 ; k < 3 ; k++)
+                    for(unsigned int m = 0 ; m < 3 ; m++)
+                        P[3*k+m] = R_true[9*edge.j+3*k]*R_true[9*i+3*m] + R_true[9*edge.j+3*k+1]*R_true[9*i+3*m+1] + R_true[9*edge.j+3*k+2]*R_true[9*i+3*m+2];
+                mult3x3(N, P, edge.R);
+                edges.push_back(edge);
+            }
+        for(unsigned int k = 0 ; k < 9 ; k++)
+            R[k] = R_true[k];
+        for(unsigned int n = 1 ; n < nbNodes ; n++)
+            mult3x3(edges[n-1].R, &R[9*(n-1)], &R[9*n]);
+        
+        unsigned int nbIterations = averageRotations(edges, R, w);
+        double errMax = 0.;
+        for(unsigned int n = 0 ; n < nbNodes ; n++)
+        {
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                for(unsigned int m = 0 ; m < 3 ; m++)
+                    E[3*k+m] = R[9*n+3*k]*R_true[9*n+3*m] + R[9*n+3*k+1]*R_true[9*n+3*m+1] + R[9*n+3*k+2]*R_true[9*n+3*m+2];
+            rotationLog(E, v);
+            errMax = std::max(errMax, sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]));
+        }
+        //the outliers, and only them, are down-weighted
+        unsigned int nbOutliers = 0, nbMisweighted = 0;
+        for(unsigned int e = 0 ; e < edges.size() ; e++)
+        {
+            bool outlier = (edges[e].j == edges[e].i + 2) && (edges[e].i % 7 == 3);
+            if(outlier)
+                nbOutliers++;
+            if(outlier != (w[e] < 0.5))
+                nbMisweighted++;
+        }
+        bool ok = (errMax < CHECKS_RA_TOLERANCE) && (nbMisweighted == 0);
+        std::cout << "rotation averaging check " << (ok ? "passed" : "FAILED") << ": maximum error " << errMax*180./M_PI << " deg after " << nbIterations << " iterations, " << nbMisweighted << " of " << edges.size() << " edges (" << nbOutliers << " outliers) wrongly weighted" << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    //IMU integration: text and binary logs of samples every 10 ms of rates about a fixed random axis, of magnitude growing linearly with time (so that the midpoint integration is exact),
+    //the relative pose integrated between two times between samples having to be the transposed exponential of the integrated rotation vector (in the camera axes), and times out of the log being rejected
+    {
+        const unsigned int nbSamples = 101;
+        const double t0 = 0.123, t1 = 0.789;
+        const char *filenames[2] = {"checks_imu.txt", "checks_imu.bin"};
+        double a[3], cRi[9], thetaU[3] = {IMU_TO_CAMERA_THETAU};
+        for(unsigned int k = 0 ; k < 3 ; k++)
+            a[k] = uniform(gen);
+        rotationExp(thetaU, cRi);
+        std::ofstream ficTxt(filenames[0]), ficBin(filenames[1], std::ios::out | std::ios::binary);
+        ficTxt << "t wx wy wz" << std::endl << std::setprecision(17);
+        for(unsigned int i = 0 ; i < nbSamples ; i++)
+        {
+            double v[4] = {0.01*i, 0., 0., 0.};
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                v[1+k] = (1. + 2.*v[0])*a[k];
+            ficTxt << v[0] << " " << v[1] << " " << v[2] << " " << v[3] << std::endl;
+            ficBin.write((const char *)v, 4*sizeof(double));
+        }
+        ficTxt.close();
+        ficBin.close();
+        
+        //integral of 1 + 2t from t0 to t1
+        double angle = (t1 - t0) + (t1*t1 - t0*t0), w[3], R[9];
+        for(unsigned int k = 0 ; k < 3 ; k++)
+            w[k] = (cRi[3*k]*a[0] + cRi[3*k+1]*a[1] + cRi[3*k+2]*a[2])*angle;
+        rotationExp(w, R);
+        bool ok = true;
+        double errMax = 0.;
+        for(unsigned int f = 0 ; f < 2 ; f++)
+        {
+            ImuIntegrator imu;
+            vpHomogeneousMatrix dMc, dMc_out;
+            ok = ok && imu.load(filenames[f]) && (imu.size() == nbSamples) && imu.integrate(t0, t1, dMc);
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                for(unsigned int m = 0 ; m < 3 ; m++)
+                    errMax = std::max(errMax, fabs(dMc[k][m] - R[3*m+k]));
+            ok = ok && !imu.integrate(-0.1, t1, dMc_out) && !imu.integrate(t0, 1.1, dMc_out) && !imu.integrate(t1, t0, dMc_out);
+            std::remove(filenames[f]);
+        }
+        ok = ok && (errMax < 1e-9);
+        std::cout << "IMU integration check " << (ok ? "passed" : "FAILED") << ": largest rotation matrix error " << errMax << " over the text and binary logs" << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    //real-time scheduling: a sequence of synthetic acquisition times CHECKS_FRAME_PERIOD ms apart, every image being processed in CHECKS_PROCESSING_TIME ms (slower than real time), the processed
+    //and dropped images having to cover the sequence for every policy. Policy 0 processes every image, drop-to-latest only images arrived less than a period before the previous one ended, and the adaptive
+    //step (latency target of twice the processing time) grows until the latency stops growing. The latency bounds use the longest measured processing time, as waits may overshoot on a loaded machine
+    {
+        const unsigned int i0 = 0, i360 = 99;
+        const double latencyTarget = 2.*CHECKS_PROCESSING_TIME;
+        std::vector<double> v_frameTimes(i360 + 1);
+        for(unsigned int i = 0 ; i <= i360 ; i++)
+            v_frameTimes[i] = 0.001*CHECKS_FRAME_PERIOD*i;
+        unsigned int nbProcessed[3], nbDropped[3];
+        double maxLatency[3], maxProcessing = 0.;
+        bool ok = true;
+        for(unsigned int policy = FrameScheduler::ALL ; policy <= FrameScheduler::ADAPTIVE_STEP ; policy++)
+        {
+            FrameScheduler scheduler(policy, latencyTarget, i0, i360, 1, v_frameTimes);
+            nbProcessed[policy] = 0;
+            for(unsigned int imNum = i0 ; imNum <= i360 ; imNum = scheduler.next(imNum))
+            {
+                scheduler.wait(imNum);
+                double t = vpTime::measureTimeMs();
+                vpTime::wait(CHECKS_PROCESSING_TIME);
+                maxProcessing = std::max(maxProcessing, vpTime::measureTimeMs() - t);
+                nbProcessed[policy]++;
+            }
+            nbDropped[policy] = scheduler.getNbDropped();
+            const std::vector<double> &v_latencies = scheduler.getLatencies();
+            maxLatency[policy] = v_latencies.empty() ? 0. : *std::max_element(v_latencies.begin(), v_latencies.end());
+            ok = ok && (nbProcessed[policy] + nbDropped[policy] == i360 - i0 + 1) && (v_latencies.size() == (scheduler.isRealTime() ? nbProcessed[policy] : 0));
+        }
+        ok = ok && (nbDropped[FrameScheduler::ALL] == 0) && (nbDropped[FrameScheduler::DROP_TO_LATEST] > 0) && (nbDropped[FrameScheduler::ADAPTIVE_STEP] > 0);
+        ok = ok && (maxLatency[FrameScheduler::DROP_TO_LATEST] < CHECKS_FRAME_PERIOD + 2.*maxProcessing) && (maxLatency[FrameScheduler::ADAPTIVE_STEP] < latencyTarget + 2.*maxProcessing);
+        std::cout << "real-time scheduling check " << (ok ? "passed" : "FAILED") << ": processed images (dropped ones) of the 3 policies " << nbProcessed[0] << " (" << nbDropped[0] << "), " << nbProcessed[1] << " (" << nbDropped[1] << "), " << nbProcessed[2] << " (" << nbDropped[2] << "), max latency of drop-to-latest " << maxLatency[1] << " ms, of the adaptive step " << maxLatency[2] << " ms (processing up to " << maxProcessing << " ms)" << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    //checkpoint round trip: two states (scalars, pose, matrix, vectors of doubles and of poses, empty vector) posted in turn to the writer after the magic number and version, the file
+    //left once the writer is destroyed having to hold the second one bit for bit, without the temporary file, and the reading of a truncated copy having to fail at its last value
+    {
+        const std::string filename = "checks_checkpoint.bin";
+        vpPoseVector r(uniform(gen), uniform(gen), uniform(gen), uniform(gen), uniform(gen), uniform(gen));
+        vpHomogeneousMatrix M(r);
+        std::vector<double> v(17);
+        for(unsigned int i = 0 ; i < v.size() ; i++)
+            v[i] = normal(gen);
+        std::vector<vpPoseVector> v_r(3, r);
+        v_r[1][4] = normal(gen);
+        std::vector<int> v_empty;
+        Checkpoint checkpoint;
+        {
+            CheckpointWriter writer(filename);
+            for(int pass = 0 ; pass < 2 ; pass++)
+            {
+                checkpoint.clear();
+                checkpoint.put(CHECKPOINT_MAGIC);
+                checkpoint.put(CHECKPOINT_VERSION);
+                checkpoint.put(pass);
+                checkpoint.put(r); checkpoint.put(M); checkpoint.put(v); checkpoint.put(v_r); checkpoint.put(v_empty);
+                checkpoint.put(CHECKS_LAMBDA_G);
+                writer.post(checkpoint);
+            }
+        }
+        
+        unsigned int magic = 0, version = 0;
+        int pass = -1;
+        float lambda_g = 0.f;
+        vpPoseVector r_loaded;
+        vpHomogeneousMatrix M_loaded;
+        std::vector<double> v_loaded;
+        std::vector<vpPoseVector> v_r_loaded;
+        std::vector<int> v_empty_loaded(1);
+        bool ok = checkpoint.load(filename.c_str()) && checkpoint.get(magic) && (magic == CHECKPOINT_MAGIC) && checkpoint.get(version) && (version == CHECKPOINT_VERSION) && checkpoint.get(pass) && (pass == 1)
+                  && checkpoint.get(r_loaded) && checkpoint.get(M_loaded) && checkpoint.get(v_loaded) && checkpoint.get(v_r_loaded) && checkpoint.get(v_empty_loaded) && checkpoint.get(lambda_g) && !checkpoint.get(pass);
+        for(unsigned int k = 0 ; k < 6 ; k++)
+            ok = ok && (r_loaded[k] == r[k]);
+        for(unsigned int k = 0 ; k < 4 ; k++)
+            for(unsigned int m = 0 ; m < 4 ; m++)
+                ok = ok && (M_loaded[k][m] == M[k][m]);
+        ok = ok && (v_loaded == v) && (v_r_loaded.size() == v_r.size()) && v_empty_loaded.empty() && (lambda_g == CHECKS_LAMBDA_G);
+        for(unsigned int i = 0 ; (i < v_r_loaded.size()) && ok ; i++)
+            for(unsigned int k = 0 ; k < 6 ; k++)
+                ok = ok && (v_r_loaded[i][k] == v_r[i][k]);
+        unsigned int size = checkpoint.data.size();
+        
+        std::ifstream ficTmp((filename + ".tmp").c_str());
+        ok = ok && !ficTmp.is_open();
+        ficTmp.close();
+        
+        //truncated copy: every value but the last one is read back
+        {
+            std::ofstream fic(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+            fic.write(checkpoint.data.data(), checkpoint.data.size() - 1);
+        }
+        ok = ok && checkpoint.load(filename.c_str()) && checkpoint.get(magic) && checkpoint.get(version) && checkpoint.get(pass)
+                && checkpoint.get(r_loaded) && checkpoint.get(M_loaded) && checkpoint.get(v_loaded) && checkpoint.get(v_r_loaded) && checkpoint.get(v_empty_loaded) && !checkpoint.get(lambda_g);
+        std::remove(filename.c_str());
+        std::cout << "checkpoint check " << (ok ? "passed" : "FAILED") << ": round trip of a " << size << " bytes checkpoint through the writer" << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    //SO(3) correlation: equirectangular images of a few Gaussian blobs, the desired one rotated by a random rotation R (I_des(X) = I_req(R^T X)),
+    //the first maximum of the correlation of the desired image with the request one being R (the initial guess of initType 2), within the angular step of the grid
+    {
+        SO3Correlation so3Corr(SO3_FFT_BANDWIDTH);
+        unsigned int ehaut = so3Corr.getHeight();
+        double w[3], R[9], Id[9] = {1., 0., 0., 0., 1., 0., 0., 0., 1.}, E[9], Rp[9];
+        for(unsigned int k = 0 ; k < 3 ; k++)
+            w[k] = uniform(gen);
+        rotationExp(w, R);
+        vpImage<unsigned char> I_req, I_des;
+        renderBlobs(I_req, ehaut, Id);
+        renderBlobs(I_des, ehaut, R);
+        std::vector<std::complex<double> > flm_req, flm_des;
+        so3Corr.spectrum(I_req, flm_req);
+        so3Corr.spectrum(I_des, flm_des);
+        std::vector<vpPoseVector> v_r;
+        so3Corr.peaks(flm_des, flm_req, SO3_FFT_NB_PEAKS, v_r);
+        double err = M_PI;
+        if(!v_r.empty())
+        {
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                w[k] = v_r[0][3+k];
+            rotationExp(w, Rp);
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                for(unsigned int m = 0 ; m < 3 ; m++)
+                    E[3*k+m] = Rp[3*k]*R[3*m] + Rp[3*k+1]*R[3*m+1] + Rp[3*k+2]*R[3*m+2];
+            rotationLog(E, w);
+            err = sqrt(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]);
+        }
+        bool ok = (err < M_PI/SO3_FFT_BANDWIDTH);
+        std::cout << "SO(3) correlation check " << (ok ? "passed" : "FAILED") << ": first maximum " << err*180./M_PI << " deg from the rotation (grid step " << 180./SO3_FFT_BANDWIDTH << " deg)" << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    //single precision kernels: SSD and gradient term of residualsFloat and dotFloat against the double precision sums of the same values, for the 40962 features of a subdivision level 6 mesh,
+    //the error of the gradient term being relative to the sum of its absolute terms (the sum itself may cancel)
+    {
+        const unsigned int n = 40962;
+        std::vector<float> s_req(n), s_des(n), J(n), e(n);
+        double ssd = 0., g = 0., gAbs = 0., d;
+        for(unsigned int i = 0 ; i < n ; i++)
+        {
+            s_req[i] = uniform(gen);
+            s_des[i] = s_req[i] + 0.1*normal(gen);
+            J[i] = normal(gen);
+            d = (double)s_des[i] - (double)s_req[i];
+            ssd += d*d;
+            g += J[i]*d;
+            gAbs += fabs(J[i]*d);
+        }
+        double errSSD = fabs(residualsFloat(s_des.data(), s_req.data(), n, e.data()) - ssd)/ssd;
+        double errGradient = fabs(dotFloat(J.data(), e.data(), n) - g)/gAbs;
+        bool ok = (errSSD < CHECKS_FLOAT_RELATIVE) && (errGradient < CHECKS_FLOAT_RELATIVE);
+        std::cout << "single precision kernels check " << (ok ? "passed" : "FAILED") << ": relative errors " << errSSD << " (SSD) and " << errGradient << " (gradient) for " << n << " features" << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    //batched M-estimator: Gaussian residuals of standard deviation 1, CHECKS_OUTLIERS of them being replaced by outliers beyond 20, whose scale (robustScale) is 1 within CHECKS_SCALE_TOLERANCE
+    //(the outliers raise the median absolute deviation) and whose Tukey weights (tukeyWeights) are zero for the outliers only
+    {
+        const unsigned int n = 40962;
+        std::vector<float> e(n), wt(n), buf;
+        std::vector<bool> outlier(n);
+        for(unsigned int i = 0 ; i < n ; i++)
+        {
+            outlier[i] = (0.5*(uniform(gen)+1.) < CHECKS_OUTLIERS);
+            e[i] = outlier[i] ? ((uniform(gen) < 0.) ? -1. : 1.)*(20. + 10.*fabs(uniform(gen))) : normal(gen);
+        }
+        float scale = robustScale(e.data(), n, buf);
+        tukeyWeights(e.data(), n, scale, wt.data());
+        unsigned int nbMisweighted = 0;
+        for(unsigned int i = 0 ; i < n ; i++)
+            if(outlier[i] != (wt[i] == 0.f))
+                nbMisweighted++;
+        bool ok = (fabs(scale - 1.) < CHECKS_SCALE_TOLERANCE) && (nbMisweighted == 0);
+        std::cout << "M-estimator kernels check " << (ok ? "passed" : "FAILED") << ": scale " << scale << ", " << nbMisweighted << " of " << n << " residuals wrongly weighted" << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    //key image promotion (libPeR): a features set built without its pose Jacobian, then built again with it from the same spherical image when it becomes the request one, must be tracked exactly as the features set
+    //built with its pose Jacobian at once, on the blobs image and a copy of it rotated by CHECKS_ROTATION about the vertical axis
+    {
+        unsigned int ehaut = 4*SO3_FFT_BANDWIDTH, elarg = 2*ehaut;
+        double w[3] = {0., CHECKS_ROTATION, 0.}, R[9], Id[9] = {1., 0., 0., 0., 1., 0., 0., 0., 1.};
+        rotationExp(w, R);
+        vpImage<unsigned char> I_a, I_b, Mask_eq(ehaut, elarg, 255);
+        renderBlobs(I_a, ehaut, Id);
+        renderBlobs(I_b, ehaut, R);
+        prEquirectangular ecam(elarg*0.5/M_PI, ehaut*0.5/(M_PI*0.5), elarg*0.5, ehaut*0.5);
+        prRegularlySampledCSImage<unsigned char> IS(CHECKS_SUBDIV_LEVEL);
+        IS.setInterpType(INTERPTYPE);
+        prRegularlySampledCSImage<float> GS(CHECKS_SUBDIV_LEVEL);
+        prPhotometricGMS<prCartesian3DPointVec> GS_sample(CHECKS_LAMBDA_G);
+        MPPFeaturesSet fSet_eager, fSet_lazy, fSet_des_eager, fSet_des_lazy;
+        IS.buildFromEquiRect(I_a, ecam, &Mask_eq);
+        IS.toAbsZN();
+        fSet_lazy.buildFrom(IS, GS, GS_sample, false);
+        fSet_eager.buildFrom(IS, GS, GS_sample, true);
+        fSet_lazy.buildFrom(IS, GS, GS_sample, true);
+        IS.buildFromEquiRect(I_b, ecam, &Mask_eq);
+        IS.toAbsZN();
+        fSet_des_eager.buildFrom(IS, GS, GS_sample, false);
+        fSet_des_lazy = fSet_des_eager;
+        
+        MPPGyro gyroEager, gyroLazy;
+        gyroEager.setdof(false, false, false, true, true, true);
+        gyroLazy.setdof(false, false, false, true, true, true);
+        gyroEager.buildFrom(fSet_eager);
+        gyroLazy.buildFrom(fSet_lazy);
+        vpPoseVector r_eager(0.0, 0.0, 0.0, 0.0, 0.0, 0.0), r_lazy(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+        double errEager = gyroEager.track(fSet_des_eager, r_eager, 1.0, false), errLazy = gyroLazy.track(fSet_des_lazy, r_lazy, 1.0, false);
+        bool ok = (fSet_lazy.set.size() == fSet_eager.set.size()) && (errLazy == errEager);
+        for(unsigned int k = 0 ; k < 6 ; k++)
+            ok = ok && (r_lazy[k] == r_eager[k]);
+        std::cout << "key image promotion check " << (ok ? "passed" : "FAILED") << ": eager pose " << r_eager.t() << " MPP-SSD " << errEager << ", promoted pose " << r_lazy.t() << " MPP-SSD " << errLazy << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    //inverse compositional and ESM laws (libPeR): from the null pose, the orientation between the blobs image and a copy of it rotated by CHECKS_ROTATION about the three axes is the one of the Gauss-Newton law
+    //of prPoseSphericalEstim within CHECKS_LAW_TOLERANCE degrees, of angle CHECKS_ROTATION within 10 % (whatever the sign convention of the poses), the laws being timed
+    {
+        double w[3];
+        for(unsigned int k = 0 ; k < 3 ; k++)
+            w[k] = CHECKS_ROTATION/sqrt(3.);
+        MPPFeaturesSet fSet_req, fSet_des;
+        syntheticFeaturesSets(w, fSet_req, fSet_des, true);
+        bool dofs[6] = {false, false, false, true, true, true};
+        //the inverse compositional and ESM laws are built first, gyro.track moving the request features set
+        MPPGyroIC icGyro[2];
+        for(unsigned int law = 0 ; law < 2 ; law++)
+        {
+            icGyro[law].setdof(dofs);
+            icGyro[law].setESM(law == 1);
+            icGyro[law].buildFrom(fSet_req);
+        }
+        MPPGyro gyro;
+        gyro.setdof(dofs[0], dofs[1], dofs[2], dofs[3], dofs[4], dofs[5]);
+        gyro.buildFrom(fSet_req);
+        vpPoseVector r_gn(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+        double t = vpTime::measureTimeMs();
+        gyro.track(fSet_des, r_gn, 1.0, false);
+        double tGN = vpTime::measureTimeMs() - t;
+        vpHomogeneousMatrix M_gn_inv;
+        vpHomogeneousMatrix(r_gn).inverse(M_gn_inv);
+        
+        for(unsigned int law = 0 ; law < 2 ; law++)
+        {
+            vpPoseVector r(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+            t = vpTime::measureTimeMs();
+            unsigned int status = icGyro[law].track(fSet_des, r);
+            t = vpTime::measureTimeMs() - t;
+            vpPoseVector dr(M_gn_inv*vpHomogeneousMatrix(r));
+            double angle = sqrt(dr[3]*dr[3] + dr[4]*dr[4] + dr[5]*dr[5])*180./M_PI, rotation = sqrt(r[3]*r[3] + r[4]*r[4] + r[5]*r[5]);
+            bool ok = (status == MPPGyroIC::CONVERGED) && (angle < CHECKS_LAW_TOLERANCE) && (fabs(rotation - CHECKS_ROTATION) < 0.1*CHECKS_ROTATION);
+            std::cout << ((law == 1) ? "ESM" : "inverse compositional") << " check " << (ok ? "passed" : "FAILED") << ": pose " << r.t() << " after " << icGyro[law].getNbIterations() << " iterations (" << t << " ms), " << angle << " deg from the Gauss-Newton pose " << r_gn.t() << " (" << tGN << " ms)" << std::endl;
+            nbFailures += ok ? 0 : 1;
+        }
+    }
+    
+    //time budget (libPeR): with a deadline already over, the inverse compositional law returns DEADLINE before any iteration, the pose being left unchanged, and only the first of the initial guesses is
+    //evaluated (the best orientation so far), the others getting the maximum MPP-SSD; with a deadline far ahead, every guess is evaluated
+    {
+        double w[3] = {0., CHECKS_ROTATION, 0.};
+        MPPFeaturesSet fSet_req, fSet_des;
+        syntheticFeaturesSets(w, fSet_req, fSet_des, false);
+        bool dofs[6] = {false, false, false, true, true, true};
+        MPPGyroIC icGyro;
+        icGyro.setdof(dofs);
+        icGyro.buildFrom(fSet_req);
+        vpPoseVector r(0.0, 0.0, 0.0, 0.0, 0.02, 0.0), r0 = r;
+        double past = vpTime::measureTimeMs() - 1.;
+        unsigned int status = icGyro.track(fSet_des, r, past);
+        bool ok = (status == MPPGyroIC::DEADLINE) && (icGyro.getNbIterations() == 0);
+        for(unsigned int k = 0 ; k < 6 ; k++)
+            ok = ok && (r[k] == r0[k]);
+        
+        ThreadPool pool(CHECKS_POOL_THREADS);
+        std::vector<HypothesesContext> ctx;
+        std::vector<float> s_des_f;
+        std::vector<vpPoseVector> v_r;
+        std::vector<double> v_err;
+        rotationGrid(8, dofs, v_r);
+        bestHypothesis(pool, v_r, fSet_req, 0, fSet_des, s_des_f, ctx, false, false, &v_err, past);
+        unsigned int nbEvaluated = 0;
+        for(unsigned int i = 0 ; i < v_err.size() ; i++)
+            nbEvaluated += (v_err[i] < std::numeric_limits<double>::max()) ? 1 : 0;
+        ok = ok && (v_err.size() == v_r.size()) && (nbEvaluated == 1) && (v_err[0] < std::numeric_limits<double>::max());
+        bestHypothesis(pool, v_r, fSet_req, 0, fSet_des, s_des_f, ctx, false, false, &v_err, vpTime::measureTimeMs() + 1e6);
+        unsigned int nbEvaluatedAhead = 0;
+        for(unsigned int i = 0 ; i < v_err.size() ; i++)
+            nbEvaluatedAhead += (v_err[i] < std::numeric_limits<double>::max()) ? 1 : 0;
+        ok = ok && (nbEvaluatedAhead == v_r.size());
+        std::cout << "time budget check " << (ok ? "passed" : "FAILED") << ": status " << status << " after " << icGyro.getNbIterations() << " iterations with a deadline over, " << nbEvaluated << " of " << v_r.size() << " guesses evaluated (" << nbEvaluatedAhead << " with the deadline ahead)" << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    //single precision inverse compositional and ESM laws (libPeR): the orientations tracked with setFloatSSD are those tracked in double precision within FLOAT_SSD_TOLERANCE degrees,
+    //on the blobs image and a copy of it rotated by CHECKS_ROTATION about the three axes
+    {
+        unsigned int ehaut = 4*SO3_FFT_BANDWIDTH, elarg = 2*ehaut;
+        double w[3], R[9], Id[9] = {1., 0., 0., 0., 1., 0., 0., 0., 1.};
+        for(unsigned int k = 0 ; k < 3 ; k++)
+            w[k] = CHECKS_ROTATION/sqrt(3.);
+        rotationExp(w, R);
+        vpImage<unsigned char> I_a, I_b, Mask_eq(ehaut, elarg, 255);
+        renderBlobs(I_a, ehaut, Id);
+        renderBlobs(I_b, ehaut, R);
+        prEquirectangular ecam(elarg*0.5/M_PI, ehaut*0.5/(M_PI*0.5), elarg*0.5, ehaut*0.5);
+        prRegularlySampledCSImage<unsigned char> IS(CHECKS_SUBDIV_LEVEL);
+        IS.setInterpType(INTERPTYPE);
+        prRegularlySampledCSImage<float> GS(CHECKS_SUBDIV_LEVEL);
+        prPhotometricGMS<prCartesian3DPointVec> GS_sample(CHECKS_LAMBDA_G);
+        MPPFeaturesSet fSet_req, fSet_des;
+        IS.buildFromEquiRect(I_a, ecam, &Mask_eq);
+        IS.toAbsZN();
+        fSet_req.buildFrom(IS, GS, GS_sample, false);
+        IS.buildFromEquiRect(I_b, ecam, &Mask_eq);
+        IS.toAbsZN();
+        fSet_des.buildFrom(IS, GS, GS_sample, false);
+        
+        bool dofs[6] = {false, false, false, true, true, true};
+        vpHomogeneousMatrix M_double, M_float;
+        for(unsigned int law = 1 ; law <= 2 ; law++)
+        {
+            MPPGyroIC icDouble, icFloat;
+            icDouble.setdof(dofs);
+            icDouble.setESM(law == 2);
+            icDouble.buildFrom(fSet_req);
+            icFloat = icDouble;
+            icFloat.setFloatSSD(true);
+            vpPoseVector r_double(0.0, 0.0, 0.0, 0.0, 0.0, 0.0), r_float(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+            icDouble.track(fSet_des, r_double);
+            icFloat.track(fSet_des, r_float);
+            M_double.buildFrom(r_double);
+            vpHomogeneousMatrix(r_float).inverse(M_float);
+            vpPoseVector dr(M_float*M_double);
+            double angle = sqrt(dr[3]*dr[3] + dr[4]*dr[4] + dr[5]*dr[5])*180./M_PI;
+            bool ok = (angle < FLOAT_SSD_TOLERANCE);
+            std::cout << "single precision " << ((law == 2) ? "ESM" : "inverse compositional") << " check " << (ok ? "passed" : "FAILED") << ": double precision pose " << r_double.t() << ", single precision pose " << r_float.t() << ", " << angle << " deg apart" << std::endl;
+            nbFailures += ok ? 0 : 1;
+        }
+        
+        //M-estimator (libPeR): the desired image being partly occluded (an eighth of its rows, below the equator, set to black), the robust inverse compositional law ends within a quarter of CHECKS_ROTATION
+        //of the orientation tracked without the M-estimator nor the occlusion, and the time of every law with the M-estimator is measured against the time without it (mean over CHECKS_TIMING_TRACKS tracks
+        //from the null pose, Gauss-Newton law of prPoseSphericalEstim included)
+        MPPGyroIC icGyro;
+        icGyro.setdof(dofs);
+        icGyro.buildFrom(fSet_req);
+        vpPoseVector r(0.0, 0.0, 0.0, 0.0, 0.0, 0.0), r_clean(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+        icGyro.track(fSet_des, r_clean);
+        for(unsigned int v = 0 ; v < ehaut/8 ; v++)
+            for(unsigned int u = 0 ; u < elarg ; u++)
+                I_b[ehaut/2+v][u] = 0;
+        IS.buildFromEquiRect(I_b, ecam, &Mask_eq);
+        IS.toAbsZN();
+        fSet_des.buildFrom(IS, GS, GS_sample, false);
+        MPPFeaturesSet fSet_req_gn;
+        IS.buildFromEquiRect(I_a, ecam, &Mask_eq);
+        IS.toAbsZN();
+        fSet_req_gn.buildFrom(IS, GS, GS_sample, true);
+        MPPGyro gyro;
+        gyro.setdof(dofs[0], dofs[1], dofs[2], dofs[3], dofs[4], dofs[5]);
+        gyro.buildFrom(fSet_req_gn);
+        double tLaw[2][2];
+        for(unsigned int robust = 0 ; robust < 2 ; robust++)
+        {
+            icGyro.setRobust(robust == 1);
+            for(unsigned int law = 0 ; law < 2 ; law++)
+            {
+                double t = vpTime::measureTimeMs();
+                for(unsigned int k = 0 ; k < CHECKS_TIMING_TRACKS ; k++)
+                {
+                    r.set(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+                    if(law == 0)
+                        gyro.track(fSet_des, r, 1.0, robust == 1);
+                    else
+                        icGyro.track(fSet_des, r);
+                }
+                tLaw[robust][law] = (vpTime::measureTimeMs() - t)/CHECKS_TIMING_TRACKS;
+            }
+        }
+        M_double.buildFrom(r);
+        vpHomogeneousMatrix(r_clean).inverse(M_float);
+        vpPoseVector dr(M_float*M_double);
+        double err = sqrt(dr[3]*dr[3] + dr[4]*dr[4] + dr[5]*dr[5]);
+        bool ok = (err < 0.25*CHECKS_ROTATION);
+        std::cout << "M-estimator check " << (ok ? "passed" : "FAILED") << ": robust inverse compositional pose of the occluded image " << r.t() << ", " << err*180./M_PI << " deg from the pose of the image without occlusion " << r_clean.t() << std::endl;
+        std::cout << "M-estimator overhead : Gauss-Newton (prPoseSphericalEstim) " << tLaw[0][0] << " ms -> " << tLaw[1][0] << " ms (" << 100.*(tLaw[1][0]/tLaw[0][0]-1.) << " %), inverse compositional " << tLaw[0][1] << " ms -> " << tLaw[1][1] << " ms (" << 100.*(tLaw[1][1]/tLaw[0][1]-1.) << " %) per track" << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    return nbFailures;
+}
+
 /*!
  * \fn main()
  * \brief Main function of the MPP SSD based spherical orientation estimation
@@ -70,9 +914,13 @@
  *         -6 no initial file index
  *         -7 no last file index
  *         -8 no image step
+ *        -10 several reference images with an option the multi-reference tracking does not support
  */
 int main(int argc, char **argv)
 {
+    //behavior checks on synthetic data only
+    if((argc >= 2) && (std::string(argv[1]) == "--checks"))
+        return selfChecks();
     
     //1. Loading a divergent stereovision system made of two fisheye cameras considering the Barreto's model from an XML file got from the MV calibration software
     if(argc < 2)
@@ -166,7 +1014,15 @@ int main(int argc, char **argv)
 #endif
         return -5;
     }
-    unsigned int iRef = atoi(argv[5]); //72
+    //a comma separated list of reference images tracks every image against all of them (pure gyro), the first one being the reference image of the other estimation types
+    std::vector<unsigned int> v_iRef;
+    {
+        std::istringstream ssRef(argv[5]);
+        std::string sRef;
+        while(std::getline(ssRef, sRef, ','))
+            v_iRef.push_back(atoi(sRef.c_str()));
+    }
+    unsigned int iRef = v_iRef.empty() ? 0 : v_iRef[0]; //72
     
     if(argc < 7)
     {
@@ -194,6 +1050,8 @@ int main(int argc, char **argv)
         return -8;
     }
     unsigned int iStep = atoi(argv[8]);
+    if(iStep == 0)
+        iStep = 1;
 
     
     sprintf(myFilter, "%06d.*\\.%s", iRef, ext);
@@ -287,58 +1145,437 @@ int main(int argc, char **argv)
     }
     else
     {
-        ficInit = true;
-
         std::ifstream ficPosesInit(argv[13]);
-        vpPoseVector r;
-        while(!ficPosesInit.eof())
+        if(ficPosesInit.is_open())
+        {
+            ficInit = true;
+            
+            vpPoseVector r;
+            while(!ficPosesInit.eof())
+            {
+                ficPosesInit >> r[0] >> r[1] >> r[2] >> r[3] >> r[4] >> r[5];
+                v_pv_init.push_back(r);
+            }
+            ficPosesInit.close();
+        }
+        else
         {
-            ficPosesInit >> r[0] >> r[1] >> r[2] >> r[3] >> r[4] >> r[5];
-            v_pv_init.push_back(r);
+#ifdef VERBOSE
+            std::cout << "initial poses file does not exist" << std::endl;
+#endif
         }
-        ficPosesInit.close();
     }
-
-    
-    // 2. Gyro objects initialization, considering the pose estimation of a spherical camera from the feature set of photometric Gaussian mixture 3D samples compared thanks to the SSD
     
-    /*
-    //En image plane
-    prPhotometricGMS<pr2DCartesianPointVec> G_sample;
-    pr2DCartesianPointVec u_g;
-    G_sample.buildFrom(I_req, u_g, lambda_g);
-    */
+    //nombre de threads (0 : autant que de coeurs)
+    unsigned int nbThreads = 0;
+    if(argc < 15)
+    {
+#ifdef VERBOSE
+        std::cout << "no number of threads given" << std::endl;
+#endif
+    }
+    else
+        nbThreads = atoi(argv[14]);
+    if(nbThreads == 0)
+        nbThreads = std::max(std::thread::hardware_concurrency(), 1u);
     
-    //En image spherique
-    //initialisation de l'estimation d'orientation
-    prPoseSphericalEstim<prFeaturesSet<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec>, prRegularlySampledCSImage >, prSSDCmp<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec> > > gyro;
-//    bool dofs[6] = {false, false, false, true, false, false}; //"compas"
-    bool dofs[6] = {false, false, false, true, true, true}; //"gyro"
-
-    gyro.setdof(dofs[0], dofs[1], dofs[2], dofs[3], dofs[4], dofs[5]);
-
-    //prepare the request spherical image (here, the reference image is always considered as the request in order to compute the rotations that allow to rotate it to the current image)
-    prRegularlySampledCSImage<unsigned char> IS_req(subdivLevel); //the regularly sample spherical image to be set from the acquired/loaded dual fisheye image
-    IS_req.setInterpType(prInterpType::IMAGEPLANE_BILINEAR);
+    //budget de temps par image en ms (0 : pas de limite)
+    double budget = 0.;
+    if(argc < 16)
+    {
+#ifdef VERBOSE
+        std::cout << "no time budget given" << std::endl;
+#endif
+    }
+    else
+        budget = atof(argv[15]);
     
-    IS_req.buildFromTwinOmni(I_req, stereoCam, &Mask); // Goulot !
-    IS_req.toAbsZN(); //prepare spherical pixels intensities for the MPP cost function expression constraints
-    prRegularlySampledCSImage<float> GS(subdivLevel); //contient tous les pr3DCartesianPointVec XS_g et fera GS_sample.buildFrom(IS_req, XS_g);
+    //politique de changement d'image cle (0 : seuil fixe sur la MPP-SSD, 1 : adaptative)
+    unsigned int keyPolicy = 0;
+    if(argc < 17)
+    {
+#ifdef VERBOSE
+        std::cout << "no key image switching policy given" << std::endl;
+#endif
+    }
+    else
+        keyPolicy = atoi(argv[16]);
     
-    prFeaturesSet<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec>,prRegularlySampledCSImage > fSet_req;
-    prPhotometricGMS<prCartesian3DPointVec> GS_sample_req(lambda_g);
-    // TODO : calculer en parallele un fSet_req avec lambda_g /= 10 pour les dernières itérations --> précision accrue, sans perdre de temps
-    fSet_req.buildFrom(IS_req, GS, GS_sample_req);
-
-    gyro.buildFrom(fSet_req);
+    //seuil de MPP-SSD de changement d'image cle
+    double seuilErr = 0.0325; //0.015; //0.0077;// // OK pour 0,325 seul et subdiv3
+    if(argc < 18)
+    {
+#ifdef VERBOSE
+        std::cout << "no key image switching threshold given" << std::endl;
+#endif
+    }
+    else
+        seuilErr = atof(argv[17]);
     
-    prPhotometricGMS<prCartesian3DPointVec> GS_sample(lambda_g);
-    std::cout << "nb features : " << fSet_req.set.size() << std::endl;
+    //fichier des vitesses angulaires de la centrale inertielle, integrees entre les images pour initialiser (et contraindre faiblement) l'estimation
+    ImuIntegrator imu;
+    bool imuPrior = false;
+    if(argc < 19)
+    {
+#ifdef VERBOSE
+        std::cout << "no IMU file given" << std::endl;
+#endif
+    }
+    else
+    {
+        imuPrior = imu.load(argv[18]);
+        std::cout << "IMU file " << argv[18] << (imuPrior ? " loaded: " : " ignored") << (imuPrior ? imu.size() : 0) << std::endl;
+    }
     
-    vpDisplayX disp2;
+    //fichier des instants d'acquisition des images (lignes "numero_image t"), dans la base de temps de la centrale inertielle
+    std::vector<double> v_frameTimes;
+    if(argc >= 20)
+    {
+        std::ifstream ficTimes(argv[19]);
+        if(ficTimes.is_open())
+        {
+            std::string line;
+            unsigned int num;
+            double t;
+            while(std::getline(ficTimes, line))
+            {
+                std::istringstream iss(line);
+                if(!(iss >> num >> t))
+                    continue;
+                if(num >= v_frameTimes.size())
+                    v_frameTimes.resize(num+1, std::numeric_limits<double>::quiet_NaN());
+                v_frameTimes[num] = t;
+            }
+            ficTimes.close();
+        }
+    }
+    if(imuPrior && v_frameTimes.empty())
+    {
+        std::cout << "no image times file given, the IMU file is ignored" << std::endl;
+        imuPrior = false;
+    }
     
-    //to save iterations
-    std::ostringstream s;
+    //ordonnancement temps reel (0 : toutes les images, 1 : la plus recente arrivee, 2 : pas adaptatif) et latence cible (en ms)
+    unsigned int schedulePolicy = 0;
+    double latencyTarget = FRAME_PERIOD;
+    if(argc < 21)
+    {
+#ifdef VERBOSE
+        std::cout << "no real-time scheduling policy given" << std::endl;
+#endif
+    }
+    else
+        schedulePolicy = atoi(argv[20]);
+    if(argc < 22)
+    {
+#ifdef VERBOSE
+        std::cout << "no latency target given" << std::endl;
+#endif
+    }
+    else
+        latencyTarget = atof(argv[21]);
+    
+    //periode (en images traitees) des points de reprise (0 : aucun) et reprise depuis le dernier point de reprise (0 : non, 1 : oui)
+    unsigned int checkpointPeriod = 0;
+    if(argc < 23)
+    {
+#ifdef VERBOSE
+        std::cout << "no checkpoint period given" << std::endl;
+#endif
+    }
+    else
+        checkpointPeriod = atoi(argv[22]);
+    bool resume = false;
+    if(argc < 24)
+    {
+#ifdef VERBOSE
+        std::cout << "no resume option given" << std::endl;
+#endif
+    }
+    else
+        resume = (atoi(argv[23]) != 0);
+    
+    //selection des points saillants (0 : tous, ]0,1[ : proportion gardee, >= 1 : nombre garde)
+    double featuresSelection = 0.;
+    if(argc < 25)
+    {
+#ifdef VERBOSE
+        std::cout << "no features selection given" << std::endl;
+#endif
+    }
+    else
+        featuresSelection = atof(argv[24]);
+    
+    //nombre de niveaux de subdivision de la pyramide (1 : pas de pyramide)
+    unsigned int nbPyramidLevels = 1;
+    if(argc < 26)
+    {
+#ifdef VERBOSE
+        std::cout << "no number of pyramid levels given" << std::endl;
+#endif
+    }
+    else
+        nbPyramidLevels = atoi(argv[25]);
+    
+    //strategie des essais initiaux (0 : grille d'angles d'Euler, 1 : echantillons uniformes de SO(3) elagues, 2 : maxima de la correlation sur SO(3))
+    unsigned int initType = 0;
+    if(argc < 27)
+    {
+#ifdef VERBOSE
+        std::cout << "no initial guesses strategy given" << std::endl;
+#endif
+    }
+    else
+        initType = atoi(argv[26]);
+    
+    //modele de mouvement de l'estimation initiale (0 : aucun, 1 : vitesse constante, 2 : acceleration constante, 3 : vitesse lissee)
+    unsigned int predictorType = 0;
+    if(argc < 28)
+    {
+#ifdef VERBOSE
+        std::cout << "no motion model given" << std::endl;
+#endif
+    }
+    else
+        predictorType = atoi(argv[27]);
+    
+    //loi d'optimisation (0 : Gauss-Newton de prPoseSphericalEstim, 1 : compositionnelle inverse, 2 : ESM)
+    unsigned int optimLaw = 0;
+    if(argc < 29)
+    {
+#ifdef VERBOSE
+        std::cout << "no optimization law given" << std::endl;
+#endif
+    }
+    else
+        optimLaw = atoi(argv[28]);
+    
+    //nombre d'hypotheses d'orientation gardees d'une image a la suivante (0 : aucune)
+    unsigned int nbHypotheses = 0;
+    if(argc < 30)
+    {
+#ifdef VERBOSE
+        std::cout << "no number of hypotheses given" << std::endl;
+#endif
+    }
+    else
+        nbHypotheses = atoi(argv[29]);
+    
+    //base des images cles (0 : non, 1 : oui)
+    bool keyDatabase = false;
+    if(argc < 31)
+    {
+#ifdef VERBOSE
+        std::cout << "no key images database option given" << std::endl;
+#endif
+    }
+    else
+        keyDatabase = (atoi(argv[30]) != 0);
+    
+    //moyennage des rotations des images cles (0 : non, 1 : oui)
+    bool rotationAveraging = false;
+    if(argc < 32)
+    {
+#ifdef VERBOSE
+        std::cout << "no rotation averaging option given" << std::endl;
+#endif
+    }
+    else
+        rotationAveraging = (atoi(argv[31]) != 0);
+    
+    //odometrie parallele par segments (0 : non, 1 : oui)
+    bool segmentParallel = false;
+    if(argc < 33)
+    {
+#ifdef VERBOSE
+        std::cout << "no segment-parallel option given" << std::endl;
+#endif
+    }
+    else
+        segmentParallel = (atoi(argv[32]) != 0);
+    
+    //gyro pur parallele par images (0 : non, 1 : oui)
+    bool frameParallel = false;
+    if(argc < 34)
+    {
+#ifdef VERBOSE
+        std::cout << "no frame-parallel option given" << std::endl;
+#endif
+    }
+    else
+        frameParallel = (atoi(argv[33]) != 0);
+    
+    //MPP-SSD en simple precision (0 : non, 1 : oui)
+    bool floatSSD = false;
+    if(argc < 35)
+    {
+#ifdef VERBOSE
+        std::cout << "no single precision MPP-SSD option given" << std::endl;
+#endif
+    }
+    else
+        floatSSD = (atoi(argv[34]) != 0);
+    
+    //M-estimateur (0 : non, 1 : oui)
+    bool robust = false;
+    if(argc < 36)
+    {
+#ifdef VERBOSE
+        std::cout << "no M-estimator option given" << std::endl;
+#endif
+    }
+    else
+        robust = (atoi(argv[35]) != 0);
+    
+    //nombre maximal d'iterations des lois compositionnelle inverse et ESM aux niveaux grossiers de la pyramide (0 : IC_MAX_ITERATIONS)
+    unsigned int pyramidIterations = 0;
+    if(argc < 37)
+    {
+#ifdef VERBOSE
+        std::cout << "no maximum number of iterations of the pyramid coarse levels given" << std::endl;
+#endif
+    }
+    else
+        pyramidIterations = atoi(argv[36]);
+    
+    //multi-reference tracking (pure gyro, several reference images given): every image is loaded, sampled and its desired features set built once, then tracked against every reference in parallel (one task per reference),
+    //the poses, MPP-SSD and times of every reference being saved as by separate runs, instead of the sequential loop (initial guesses grid only, no pyramid, no display)
+    bool multiReference = (v_iRef.size() > 1) && (estimationType == 0);
+    if(multiReference && (ficInit || (featuresSelection > 0.) || (nbPyramidLevels > 1) || (initType != 0) || (predictorType != 0) || imuPrior || (nbHypotheses > 0) || (budget > 0.) || (schedulePolicy != 0) || frameParallel))
+    {
+        std::cout << "multi-reference tracking takes its initial guesses from the grid only: the initial poses file, the features selection, the pyramid, the initial guesses strategies 1 and 2, the motion model, the IMU, the hypotheses, the deadline, the scheduling and the frame-parallel tracking are not available with several reference images" << std::endl;
+        return -10;
+    }
+
+    
+    // 2. Gyro objects initialization, considering the pose estimation of a spherical camera from the feature set of photometric Gaussian mixture 3D samples compared thanks to the SSD
+    
+    /*
+    //En image plane
+    prPhotometricGMS<pr2DCartesianPointVec> G_sample;
+    pr2DCartesianPointVec u_g;
+    G_sample.buildFrom(I_req, u_g, lambda_g);
+    */
+    
+    //En image spherique
+    //initialisation de l'estimation d'orientation
+    prPoseSphericalEstim<prFeaturesSet<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec>, prRegularlySampledCSImage >, prSSDCmp<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec> > > gyro;
+//    bool dofs[6] = {false, false, false, true, false, false}; //"compas"
+    bool dofs[6] = {false, false, false, true, true, true}; //"gyro"
+    
+    //initial guesses strategy: 0 nbTries guesses per rotation DOF (Euler angles grid), 1 nbTries uniform SO(3) guesses refined coarse-to-fine with pruning (3 rotation DOFs only), 2 maxima of the SO(3) correlation of the spherical harmonics of the request and desired images (nbTries ignored)
+    SO3Correlation *so3Corr = NULL;
+    std::vector<std::complex<double> > flm_req, flm_des;
+    vpImage<unsigned char> I_eq, Mask_eq;
+    vpPoseVector r_eq(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+    
+    //key images database (odometry with key images only): at every key image change, the stored key image of closest spherical harmonics signature (and close cumulative orientation) becomes the request one if the new key image registers to it with an MPP-SSD lower than the key image switching threshold
+    keyDatabase = keyDatabase && (estimationType == 2);
+    KeyImageDatabase keyDB;
+    int currentKey = 0;
+    KeyImage *key = NULL;
+    vpImage<unsigned char> I_key;
+    std::vector<int> v_reanchors; //image and key image numbers
+    
+    //rotation averaging over the key images (odometry with key images only): once the sequence is processed, every key image is also registered to RA_NB_NEIGHBOURS earlier key images of close orientation, in parallel,
+    //the cumulative rotations of the key images are estimated from all the relative rotations (robust chordal averaging) and the poses of the images are expressed with respect to their refined key image
+    rotationAveraging = rotationAveraging && (estimationType == 2);
+    std::vector<RotationEdge> v_edges;
+    RotationEdge edge;
+    std::vector<unsigned int> v_imageKey; //key image (database index) of every image
+    vpHomogeneousMatrix keyMi;
+    
+    if((initType == 2) || keyDatabase)
+        so3Corr = new SO3Correlation(SO3_FFT_BANDWIDTH);
+    unsigned int ehaut = so3Corr ? so3Corr->getHeight() : 1, elarg = 2*ehaut;
+    prEquirectangular ecam(elarg*0.5/M_PI, ehaut*0.5/(M_PI*0.5), elarg*0.5, ehaut*0.5);
+    I_eq.resize(ehaut, elarg);
+    Mask_eq.resize(ehaut, elarg, 255);
+
+    gyro.setdof(dofs[0], dofs[1], dofs[2], dofs[3], dofs[4], dofs[5]);
+    
+    //optimization law: 0 Gauss-Newton of prPoseSphericalEstim (gyro.track), 1 inverse compositional (Jacobian and Gauss-Newton matrix of the request features set computed once), 2 ESM
+    MPPGyroIC icGyro;
+    icGyro.setdof(dofs);
+    icGyro.setESM(optimLaw == 2);
+
+    //prepare the request spherical image (here, the reference image is always considered as the request in order to compute the rotations that allow to rotate it to the current image)
+    prRegularlySampledCSImage<unsigned char> IS_req(subdivLevel); //the regularly sample spherical image to be set from the acquired/loaded dual fisheye image
+    IS_req.setInterpType(prInterpType::IMAGEPLANE_BILINEAR);
+    
+    IS_req.buildFromTwinOmni(I_req, stereoCam, &Mask); // Goulot !
+    if(so3Corr)
+    {
+        IS_req.toEquiRect(I_eq, r_eq, ecam, &Mask_eq);
+        so3Corr->spectrum(I_eq, flm_req);
+    }
+    IS_req.toAbsZN(); //prepare spherical pixels intensities for the MPP cost function expression constraints
+    prRegularlySampledCSImage<float> GS(subdivLevel); //contient tous les pr3DCartesianPointVec XS_g et fera GS_sample.buildFrom(IS_req, XS_g);
+    
+    //request and desired features sets are double-buffered: when the desired one becomes the request one, buffers are swapped instead of copied
+    MPPFeaturesSet fSet_buffers[2];
+    MPPFeaturesSet *fSet_req = &fSet_buffers[0], *fSet_des = &fSet_buffers[1];
+    prPhotometricGMS<prCartesian3DPointVec> GS_sample_req(lambda_g);
+    // TODO : calculer en parallele un fSet_req avec lambda_g /= 10 pour les dernières itérations --> précision accrue, sans perdre de temps
+    fSet_req->buildFrom(IS_req, GS, GS_sample_req);
+    
+    //saliency-driven features selection: 0 keeps all the features, ]0,1[ is the ratio of features to keep, >= 1 the number of features to keep
+    std::vector<unsigned int> selectedFeatures;
+    if(featuresSelection > 0.)
+    {
+        selectSalientFeatures(*fSet_req, dofs, featuresSelection, selectedFeatures);
+        filterFeatures(*fSet_req, selectedFeatures);
+    }
+
+    if(optimLaw == 0)
+        gyro.buildFrom(*fSet_req);
+    else
+        icGyro.buildFrom(*fSet_req);
+    
+    prPhotometricGMS<prCartesian3DPointVec> GS_sample(lambda_g);
+    std::cout << "nb features : " << fSet_req->set.size() << std::endl;
+    
+    //subdivision pyramid: the orientation is first estimated on the nbPyramidLevels-1 coarser spherical images (coarsest first), then refined at subdivLevel
+    if(nbPyramidLevels < 1)
+        nbPyramidLevels = 1;
+    if(nbPyramidLevels > subdivLevel)
+        nbPyramidLevels = subdivLevel;
+    std::vector<PyramidLevel *> pyramid;
+    for(unsigned int l = subdivLevel-nbPyramidLevels+1 ; l < subdivLevel ; l++)
+    {
+        PyramidLevel *level = new PyramidLevel(l);
+        level->gyro.setdof(dofs[0], dofs[1], dofs[2], dofs[3], dofs[4], dofs[5]);
+        level->icGyro.setdof(dofs);
+        level->icGyro.setESM(optimLaw == 2);
+        if(pyramidIterations > 0)
+            level->icGyro.setMaxIterations(pyramidIterations);
+        level->IS_req.buildFromTwinOmni(I_req, stereoCam, &Mask);
+        level->IS_req.toAbsZN();
+        level->fSet_req->buildFrom(level->IS_req, level->GS, GS_sample_req);
+        if(optimLaw == 0)
+            level->gyro.buildFrom(*(level->fSet_req));
+        else
+            level->icGyro.buildFrom(*(level->fSet_req));
+        std::cout << "nb features at subdivision level " << l << " : " << level->fSet_req->set.size() << std::endl;
+        pyramid.push_back(level);
+    }
+    
+    //the reference image is the first key image
+    if(keyDatabase || rotationAveraging)
+    {
+        key = new KeyImage;
+        key->imageNum = -1;
+        key->imageFileNum = iRef;
+        if(so3Corr)
+            so3Corr->bandEnergies(flm_req, key->signature);
+        key->cumM.eye();
+        keyDB.add(key);
+    }
+    
+    vpDisplayX disp2;
+    
+    //to save iterations
+    std::ostringstream s;
     std::string filename;
     s.str("");
     s.setf(std::ios::right, std::ios::adjustfield);
@@ -355,23 +1592,562 @@ int main(int argc, char **argv)
     double temps;
     std::vector<double> v_temps;
     std::vector<unsigned int> v_keyImageNum;
-    v_temps.reserve((i360-i0)/iStep);
+    std::vector<unsigned int> v_imNumProcessed; //image number of every pose of pv
+    unsigned int nbImages = (i360 >= i0) ? (i360-i0)/iStep + 1 : 0;
+    if(ficInit && (v_pv_init.size() < nbImages))
+        std::cout << "the initial poses file holds " << v_pv_init.size() << " poses for " << nbImages << " images, the initial guesses of the next images are not read from it" << std::endl;
+    err.reserve(nbImages);
+    pv.reserve(nbImages);
+    v_imNumProcessed.reserve(nbImages);
+    v_temps.reserve(nbImages);
+#ifdef COUNT_ALLOCATIONS
+    unsigned long nbAllocationsPass, nbApplicationAllocationsPass;
+    unsigned int nbApplicationAllocationsFailures = 0;
+    std::vector<unsigned long> v_allocations;
+    v_allocations.reserve(nbImages);
+#endif
+    
+    //index the image files of the sequence once, instead of browsing the directory for every image
+    std::vector<std::string> v_imFiles(i360+1);
+    sprintf(myFilter, "([0-9]{6}).*\\.%s", ext);
+    my_filter.set_expression(myFilter);
+    boost::smatch imNumMatch;
+    for (boost::filesystem::directory_iterator iter(dir),end; iter!=end; ++iter)
+    {
+        name = iter->path().filename().string();
+        if (boost::regex_match(name, imNumMatch, my_filter))
+        {
+            unsigned int num = atoi(imNumMatch[1].str().c_str());
+            if((num <= i360) && v_imFiles[num].empty())
+                v_imFiles[num] = iter->path().string();
+        }
+    }
+    
+    vpPoseVector r, r_to_save, r_best_init, ir, r_pred;
+    vpHomogeneousMatrix key_dMc, dMd_prec, dMc, cumMd, M_pred, dM_imu;
+    
+    //motion model of the initial guess: 0 none (zero rotation with respect to the request image), 1 constant angular velocity, 2 constant angular acceleration, 3 exponentially smoothed angular velocity
+    MotionPredictor predictor(predictorType);
+    bool predicted;
+    //the inertial rates integration, when available, replaces the motion model and the initial guesses search, and is the prior of the inverse compositional and ESM laws
+    bool imuPredicted;
     
-    vpPoseVector r, r_to_save;
-    vpHomogeneousMatrix key_dMc, dMd_prec;
+    //the pose Jacobian of a desired feature set is only needed once it becomes the request set (gyro.buildFrom):
+    //at every image for odometry, only for key images (computed lazily, after tracking) for odometry with key images, never for pure gyro nor for the inverse compositional law
+    bool poseJacobianCompute = (estimationType == 1) && (optimLaw == 0);
+    //M-Estimator: Tukey weights of prSSDCmp for gyro.track and the initial guesses, batched Tukey kernel (robustScale, tukeyWeights) for the inverse compositional and ESM laws and the single precision initial guesses
+    icGyro.setRobust(robust);
+    
+    //segment-parallel odometry (odometry with or without key images, offline): [i0, i360] is split into one segment per thread, tracked in parallel from the first image of every segment as local key image,
+    //consecutive segments overlapping over SEGMENT_OVERLAP images whose poses in both segments give the relative rotation of the segments (their mean), instead of the sequential loop (no initial guesses search, no pyramid, no display)
+    segmentParallel = segmentParallel && ((estimationType == 1) || (estimationType == 2));
+    
+    //frame-parallel tracking (pure gyro, offline): the images are distributed over the threads, every thread having its own spherical images, desired features set and estimator, the request features set (and the reference data of the
+    //inverse compositional and ESM laws) being shared read-only, the results being stored in the images order, instead of the sequential loop (initial poses file or initial guesses grid only, no pyramid, no display)
+    frameParallel = frameParallel && (estimationType == 0);
+    //single precision MPP-SSD: initial guesses (Tukey robust cost if robust, instead of the prSSDCmp one) and iterations of the inverse compositional and ESM laws,
+    //the iterations of the Gauss-Newton law being those of prPoseSphericalEstim (libPeR, double precision)
+    icGyro.setFloatSSD(floatSSD);
+    for(unsigned int l = 0 ; l < pyramid.size() ; l++)
+    {
+        pyramid[l]->icGyro.setRobust(robust);
+        pyramid[l]->icGyro.setFloatSSD(floatSSD);
+    }
+    std::vector<float> s_des_f;
     
-    bool poseJacobianCompute = true;
-    //activate the M-Estimator
-    bool robust = false;//true;//
-    vpImage<unsigned char> I_des;
+    //initial guesses evaluation
+    ThreadPool pool(nbThreads);
+    std::vector<HypothesesContext> v_tries;
+    std::vector<vpPoseVector> v_r_tries;
+    long fSet_req_version = 0; //incremented at every change of the request features set
+    
+    //multi-hypothesis tracking: number of orientation hypotheses kept from one image to the next (0 for none), refined in parallel with a reduced iterations budget (inverse compositional and ESM laws) or only compared (gyro.track) at the next image, instead of the nbTries initial guesses
+    std::vector<vpHomogeneousMatrix> v_hypotheses; //cumulative poses
+    std::vector<vpPoseVector> v_r_hyp;
+    std::vector<double> v_err_hyp;
+    std::vector<unsigned int> hypOrder;
+    std::vector<HypothesisRefinement> v_refinements;
+    vpPoseVector r_dist;
+    vpImage<unsigned char> I_des, I_r;
+    
+    //time budget: the deadline of the current image, its status (0 every stage done, 1 deadline hit after some tracking stages, 2 deadline hit before any tracking stage, the pose of the previous image being kept), the number of tracking stages done (pyramid levels and finest level)
+    double deadline = 0., tStage;
+    bool deadlineHit;
+    unsigned int nbStagesDone, nbDeadlineHits = 0, nbMissingImages = 0;
+    std::vector<unsigned int> v_status, v_stages;
+    v_status.reserve(nbImages);
+    v_stages.reserve(nbImages);
+    //gyro.track cannot be interrupted: a tracking stage of optimLaw 0 only starts if its mean duration over the previous images fits before the deadline (the inverse compositional and ESM laws stop at the deadline by themselves)
+    std::vector<double> v_stageDuration(pyramid.size()+1, 0.);
+    std::vector<unsigned int> v_stageRuns(pyramid.size()+1, 0);
+    auto stageFits = [&](unsigned int stage)
+    {
+        if(deadline <= 0.)
+            return true;
+        double expected = ((optimLaw == 0) && (v_stageRuns[stage] > 0)) ? v_stageDuration[stage]/v_stageRuns[stage] : 0.;
+        return vpTime::measureTimeMs() + expected <= deadline;
+    };
+    auto stageDone = [&](unsigned int stage)
+    {
+        v_stageDuration[stage] += vpTime::measureTimeMs() - tStage;
+        v_stageRuns[stage]++;
+    };
+    //iterations of the inverse compositional and ESM laws, summed over the tracking stages
+    unsigned int nbIterationsImage;
+    std::vector<unsigned int> v_iterations;
+    v_iterations.reserve(nbImages);
+    
+    //spherical image of the current image, reused from one image to the next
+    prRegularlySampledCSImage<unsigned char> IS_des(subdivLevel);
+    IS_des.setInterpType(prInterpType::IMAGEPLANE_BILINEAR);
+    char ficRotComp[FILENAME_MAX];
     
     //3. Successive computation of the "desired" festures set for every image of the sequence that are used to register the request spherical image considering zero values angles initialization, the optimal angles of the previous image (the request image changes at every iteration), the optimal angles of the previous image (the resquest image changes only if the MPP-SSD error is greater than a threshold)
     //double angle = -177.5*M_PI/180.;
-    prFeaturesSet<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec>, prRegularlySampledCSImage > fSet_des;
-    double seuilErr = 0.0325; //0.015; //0.0077;// // OK pour 0,325 seul et subdiv3
-    while(!clickOut && (imNum <= i360))
+    MPPFeaturesSet fSet_des_sel;
+    bool fSet_des_selBuilt = false; //fSet_des_sel is a full copy of a desired features set (selectFeatures only copies the features)
+    KeySwitchPolicy keySwitchPolicy(keyPolicy, seuilErr);
+    bool keySwitch = false;
+    unsigned int nbIterationsTotal = 0;
+    std::vector<double> v_thresholds;
+    v_thresholds.reserve(nbImages);
+    if(segmentParallel)
     {
+        double tSegments = vpTime::measureTimeMs();
+        unsigned int nbSegments = std::max(std::min(pool.size(), nbImages/(2*SEGMENT_OVERLAP)), 1u);
+        std::vector<SequenceTrack> v_segments(nbSegments);
+        std::vector<unsigned int> v_core(nbSegments+1); //first image (index in the sequence) of the part of every segment that is kept
+        for(unsigned int sg = 0 ; sg <= nbSegments ; sg++)
+            v_core[sg] = (sg*nbImages)/nbSegments;
+        for(unsigned int sg = 0 ; sg < nbSegments ; sg++)
+        {
+            unsigned int first = (sg == 0) ? 0 : v_core[sg]-SEGMENT_OVERLAP;
+            for(unsigned int k = first ; k < v_core[sg+1] ; k++)
+                v_segments[sg].v_imNum.push_back(i0 + k*iStep);
+        }
+        //every segment builds its spherical images with its own stereo rig model and mask, libPeR not guaranteeing that buildFromTwinOmni leaves them untouched,
+        //an image file missing from the sequence being replaced by the previous image of the segment
+        std::vector<vpPoseVector> v_r_none;
+        pool.parallelFor(nbSegments, [&](unsigned int sg, unsigned int)
+        {
+            TwinOmniSampler sampler(argv[1], Mask, subdivLevel, lambda_g);
+            SegmentRegistration registration(dofs, optimLaw, robust, floatSSD, keyPolicy, seuilErr);
+            std::shared_ptr<vpImage<unsigned char> > I = std::make_shared<vpImage<unsigned char> >();
+            std::function<std::shared_ptr<vpImage<unsigned char> >(unsigned int)> frame = [&v_imFiles, &I](unsigned int num)
+            {
+                if(!v_imFiles[num].empty())
+                    vpImageIo::read(*I, v_imFiles[num]);
+                return I;
+            };
+            trackSequence(v_segments[sg], (sg == 0) ? &I_req : NULL, frame, sampler, registration, estimationType, v_r_none, robust);
+        });
+        
+        //stitching: the pose of the first image of a segment with respect to the reference image is the mean of the ones given by the overlap images, G = L T, T = L^-1 G
+        vpHomogeneousMatrix T, Li, G;
+        std::vector<double> v_T(9*SEGMENT_OVERLAP);
+        double R[9];
+        for(unsigned int sg = 0 ; sg < nbSegments ; sg++)
+        {
+            SequenceTrack &seg = v_segments[sg];
+            unsigned int first = (sg == 0) ? 0 : SEGMENT_OVERLAP;
+            if(sg > 0)
+            {
+                for(unsigned int o = 0 ; o < SEGMENT_OVERLAP ; o++)
+                {
+                    vpHomogeneousMatrix(seg.v_pose[o]).inverse(Li);
+                    rotationMatrix(Li*vpHomogeneousMatrix(pv[v_core[sg]-SEGMENT_OVERLAP+o]), &v_T[9*o]);
+                }
+                meanRotation(v_T, R);
+                T.eye();
+                for(unsigned int a = 0 ; a < 3 ; a++)
+                    for(unsigned int b = 0 ; b < 3 ; b++)
+                        T[a][b] = R[3*a+b];
+            }
+            else
+                T.eye();
+            
+            for(unsigned int k = 0 ; k < seg.v_keys.size() ; k++)
+                if(seg.v_keys[k] >= first)
+                    v_keyImageNum.push_back(v_core[sg] + seg.v_keys[k] - first);
+            for(unsigned int i = first ; i < seg.v_pose.size() ; i++)
+            {
+                G = vpHomogeneousMatrix(seg.v_pose[i])*T;
+                pv.push_back(vpPoseVector(G));
+                err.push_back(seg.v_err[i]);
+                v_temps.push_back(seg.v_temps[i]);
+            }
+        }
+        nbPass = pv.size();
+        std::cout << "segment-parallel odometry : " << nbSegments << " segments, " << nbPass << " images in " << vpTime::measureTimeMs()-tSegments << " ms" << std::endl;
+    }
+    
+    if(frameParallel)
+    {
+        double tFrames = vpTime::measureTimeMs();
+        std::vector<FrameWorker *> v_workers(pool.size());
+        for(unsigned int t = 0 ; t < v_workers.size() ; t++)
+        {
+            v_workers[t] = new FrameWorker(argv[1], Mask, subdivLevel, lambda_g);
+            v_workers[t]->fSet_req = *fSet_req;
+            if(optimLaw == 0)
+            {
+                v_workers[t]->gyro.setdof(dofs[0], dofs[1], dofs[2], dofs[3], dofs[4], dofs[5]);
+                v_workers[t]->gyro.buildFrom(v_workers[t]->fSet_req);
+            }
+            else
+                v_workers[t]->icGyro = icGyro;
+        }
+        std::vector<vpPoseVector> v_r_grid;
+        if(nbTries > 1)
+            rotationGrid(nbTries, dofs, v_r_grid);
+        
+        //an image whose file is missing is not tracked (whichever thread gets it): its pose is the null one, its MPP-SSD NaN and its status 3
+        pv.resize(nbImages);
+        err.resize(nbImages);
+        v_temps.resize(nbImages);
+        v_status.assign(nbImages, 0);
+        v_stages.assign(nbImages, 1);
+        pool.parallelFor(nbImages, [&](unsigned int k, unsigned int t)
+        {
+            FrameWorker &w = *v_workers[t];
+            double tFrame = vpTime::measureTimeMs();
+            unsigned int num = i0 + k*iStep;
+            vpPoseVector r_k(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+            if(v_imFiles[num].empty())
+            {
+                pv[k] = r_k;
+                err[k] = std::numeric_limits<double>::quiet_NaN();
+                v_status[k] = 3;
+                v_stages[k] = 0;
+                v_temps[k] = vpTime::measureTimeMs()-tFrame;
+                return;
+            }
+            vpImageIo::read(w.sampler.I, v_imFiles[num]);
+            w.sampler.buildFrom(w.sampler.I, w.fSet_des, false);
+            if(featuresSelection > 0.)
+                filterFeatures(w.fSet_des, selectedFeatures);
+            
+            if(ficInit && (k < v_pv_init.size()))
+                r_k = v_pv_init[k];
+            else if(!v_r_grid.empty())
+            {
+                double errMin = std::numeric_limits<double>::max(), errTry;
+                for(unsigned int i = 0 ; i < v_r_grid.size() ; i++)
+                {
+                    errTry = mppSSDDesired(w.fSet_req, w.fSet_des, v_r_grid[i], robust);
+                    if(errTry < errMin)
+                    {
+                        errMin = errTry;
+                        r_k = v_r_grid[i];
+                    }
+                }
+            }
+            
+            if(optimLaw == 0)
+                err[k] = w.gyro.track(w.fSet_des, r_k, 1.0, robust);
+            else
+            {
+                w.icGyro.track(w.fSet_des, r_k);
+                err[k] = mppSSDDesired(w.fSet_req, w.fSet_des, r_k, robust);
+            }
+            pv[k] = r_k;
+            v_temps[k] = vpTime::measureTimeMs()-tFrame;
+        });
+        
+        for(unsigned int t = 0 ; t < v_workers.size() ; t++)
+            delete v_workers[t];
+        nbPass = nbImages;
+        nbMissingImages = std::count(v_status.begin(), v_status.end(), 3u);
+        if(nbMissingImages > 0)
+            std::cout << nbMissingImages << " image files missing, not tracked (status 3)" << std::endl;
+        double tTotal = vpTime::measureTimeMs()-tFrames;
+        std::cout << "frame-parallel tracking : " << nbPass << " images on " << pool.size() << " threads in " << tTotal << " ms (" << 1000.*nbPass/tTotal << " images per second)" << std::endl;
+    }
+    
+    if(multiReference)
+    {
+        double tReferences = vpTime::measureTimeMs();
+        //the first reference is the one of the sequential loop (request features set and estimators already built), the other ones are sampled in turn with the spherical image of the desired features set
+        std::vector<ReferenceTrack *> v_refs(v_iRef.size());
+        for(unsigned int n = 0 ; n < v_refs.size() ; n++)
+        {
+            ReferenceTrack *ref = new ReferenceTrack;
+            ref->iRef = v_iRef[n];
+            if(n == 0)
+            {
+                ref->fSet_req = fSet_req;
+                ref->gyro = &gyro;
+                ref->icGyro = &icGyro;
+            }
+            else
+            {
+                sprintf(myFilter, "%06d.*\\.%s", ref->iRef, ext);
+                my_filter.set_expression(myFilter);
+                for (boost::filesystem::directory_iterator iter(dir),end; iter!=end; ++iter)
+                {
+                    name = iter->path().filename().string();
+                    if (boost::regex_match(name, my_filter))
+                    {
+                        vpImageIo::read(I_des, iter->path().string());
+                        break;
+                    }
+                }
+                IS_des.buildFromTwinOmni(I_des, stereoCam, &Mask);
+                IS_des.toAbsZN();
+                ref->fSet_own.buildFrom(IS_des, GS, GS_sample_req);
+                if(optimLaw == 0)
+                {
+                    ref->gyro_own.setdof(dofs[0], dofs[1], dofs[2], dofs[3], dofs[4], dofs[5]);
+                    ref->gyro_own.buildFrom(ref->fSet_own);
+                }
+                else
+                {
+                    ref->icGyro_own.setdof(dofs);
+                    ref->icGyro_own.setESM(optimLaw == 2);
+                    ref->icGyro_own.setRobust(robust);
+                    ref->icGyro_own.setFloatSSD(floatSSD);
+                    ref->icGyro_own.buildFrom(ref->fSet_own);
+                }
+            }
+            ref->pv.reserve(nbImages);
+            ref->err.reserve(nbImages);
+            ref->v_temps.reserve(nbImages);
+            v_refs[n] = ref;
+        }
+        std::vector<vpPoseVector> v_r_grid;
+        if(nbTries > 1)
+            rotationGrid(nbTries, dofs, v_r_grid);
+        //the desired features set is shared read-only by the references: the initial guesses (mppSSD) and the Gauss-Newton law (gyro.track) update the request features set of the reference only,
+        //whereas the inverse compositional and ESM laws update the desired one (back to the identity pose when returning), hence a copy per thread for them, made once per image
+        std::vector<MPPFeaturesSet> v_fSet_des;
+        std::vector<unsigned int> v_fSet_desNum;
+        if(optimLaw != 0)
+        {
+            v_fSet_des.resize(pool.size());
+            v_fSet_desNum.assign(pool.size(), i360+1);
+        }
+        double tShared;
+        
+        for( ; imNum <= i360 ; imNum += iStep, nbPass++)
+        {
+            //image loading, spherical sampling and desired features set, once for all the references
+            temps = vpTime::measureTimeMs();
+            if(!v_imFiles[imNum].empty())
+                vpImageIo::read(I_des, v_imFiles[imNum]);
+            IS_des.buildFromTwinOmni(I_des, stereoCam, &Mask);
+            IS_des.toAbsZN();
+            fSet_des->buildFrom(IS_des, GS, GS_sample, false);
+            tShared = vpTime::measureTimeMs()-temps;
+            
+            pool.parallelFor(v_refs.size(), [&](unsigned int n, unsigned int t)
+            {
+                ReferenceTrack &ref = *v_refs[n];
+                double tRef = vpTime::measureTimeMs();
+                vpPoseVector r_n(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+                double errMin = std::numeric_limits<double>::max(), errTry;
+                for(unsigned int i = 0 ; i < v_r_grid.size() ; i++)
+                {
+                    errTry = mppSSD(*ref.fSet_req, *fSet_des, v_r_grid[i], robust);
+                    if(errTry < errMin)
+                    {
+                        errMin = errTry;
+                        r_n = v_r_grid[i];
+                    }
+                }
+                if(optimLaw == 0)
+                    ref.err.push_back(ref.gyro->track(*fSet_des, r_n, 1.0, robust));
+                else
+                {
+                    if(v_fSet_desNum[t] != imNum)
+                    {
+                        v_fSet_des[t] = *fSet_des;
+                        v_fSet_desNum[t] = imNum;
+                    }
+                    ref.icGyro->track(v_fSet_des[t], r_n);
+                    ref.err.push_back(mppSSD(*ref.fSet_req, *fSet_des, r_n, robust));
+                }
+                ref.pv.push_back(r_n);
+                ref.v_temps.push_back(tShared + vpTime::measureTimeMs()-tRef);
+            });
+            std::cout << "image " << imNum << " tracked against " << v_refs.size() << " references" << std::endl;
+        }
+        
+        //the first reference goes through the usual saving, the other ones are saved here, with the same files
+        pv = v_refs[0]->pv;
+        err = v_refs[0]->err;
+        v_temps = v_refs[0]->v_temps;
+        for(unsigned int n = 1 ; n < v_refs.size() ; n++)
+        {
+            ReferenceTrack &ref = *v_refs[n];
+            
+            s.str("");
+            s.setf(std::ios::right, std::ios::adjustfield);
+            s << chemin << "/errors_" << ref.iRef << "_" << i0 << "_" << i360 << ".txt";
+            filename = s.str();
+            std::ofstream ficErrRef(filename.c_str());
+            for(unsigned int i = 0 ; i < ref.err.size() ; i++)
+            {
+                ficErrRef << ref.err[i] << std::endl;
+            }
+            ficErrRef.close();
+            
+            s.str("");
+            s.setf(std::ios::right, std::ios::adjustfield);
+            s << chemin << "/poses_" << ref.iRef << "_" << i0 << "_" << i360 << ".txt";
+            filename = s.str();
+            std::ofstream ficPosesRef(filename.c_str());
+            for(unsigned int i = 0 ; i < ref.pv.size() ; i++)
+            {
+                ficPosesRef << ref.pv[i].t() << std::endl;
+            }
+            ficPosesRef.close();
+            
+            s.str("");
+            s.setf(std::ios::right, std::ios::adjustfield);
+            s << chemin << "/time_" << ref.iRef << "_" << i0 << "_" << i360 << ".txt";
+            filename = s.str();
+            std::ofstream ficTimeRef(filename.c_str());
+            for(unsigned int i = 0 ; i < ref.v_temps.size() ; i++)
+            {
+                ficTimeRef << ref.v_temps[i] << std::endl;
+            }
+            ficTimeRef.close();
+        }
+        for(unsigned int n = 0 ; n < v_refs.size() ; n++)
+            delete v_refs[n];
+        std::cout << "multi-reference tracking : " << nbPass << " images against " << v_iRef.size() << " references in " << vpTime::measureTimeMs()-tReferences << " ms" << std::endl;
+    }
+    
+    //real-time scheduling of the sequential loop: the images processed are those of the scheduler, the previous one being the reference image for the first image
+    FrameScheduler scheduler(schedulePolicy, latencyTarget, i0, i360, iStep, v_frameTimes);
+    unsigned int imNumPrev = iRef;
+    
+    //checkpoints of the sequential loop state, every checkpointPeriod processed images, written asynchronously: the request and desired features sets are not saved but rebuilt from the images
+    //of their numbers at resume (the request one being the one of the key image, or of the previous image for odometry), which continues bit for bit as the uninterrupted run
+    //(but for the latencies and the iterations saved by gyro.track, which restart), the key images database and the rotation averaging are not checkpointed
+    unsigned int keyImNum = iRef;
+    bool checkpointing = (checkpointPeriod > 0) || resume;
+    if(checkpointing && (segmentParallel || frameParallel || multiReference || keyDatabase || rotationAveraging))
+    {
+        std::cout << "checkpoints are not available with segment-parallel, frame-parallel, multi-reference tracking, the key images database nor the rotation averaging" << std::endl;
+        checkpointing = false;
+    }
+    s.str("");
+    s << chemin << "/checkpoint_" << iRef << "_" << i0 << "_" << i360 << ".bin";
+    std::string checkpointFile = s.str();
+    Checkpoint checkpoint;
+    CheckpointWriter *checkpointWriter = NULL;
+    if(checkpointing && (checkpointPeriod > 0))
+        checkpointWriter = new CheckpointWriter(checkpointFile);
+    double tCheckpoint = 0.;
+    
+    if(checkpointing && resume)
+    {
+        //configuration check, then state
+        unsigned int magic = 0, version = 0, c_estimationType, c_optimLaw, c_iRef, c_i0, c_i360, c_iStep, c_subdivLevel;
+        float c_lambda_g;
+        bool loaded = checkpoint.load(checkpointFile.c_str())
+                   && checkpoint.get(magic) && (magic == CHECKPOINT_MAGIC) && checkpoint.get(version) && (version == CHECKPOINT_VERSION)
+                   && checkpoint.get(c_estimationType) && checkpoint.get(c_optimLaw) && checkpoint.get(c_iRef) && checkpoint.get(c_i0) && checkpoint.get(c_i360) && checkpoint.get(c_iStep) && checkpoint.get(c_subdivLevel) && checkpoint.get(c_lambda_g)
+                   && (c_estimationType == estimationType) && (c_optimLaw == optimLaw) && (c_iRef == iRef) && (c_i0 == i0) && (c_i360 == i360) && (c_iStep == iStep) && (c_subdivLevel == subdivLevel) && (c_lambda_g == lambda_g)
+                   && checkpoint.get(imNum) && checkpoint.get(imNumPrev) && checkpoint.get(keyImNum) && checkpoint.get(nbPass) && checkpoint.get(keySwitch)
+                   && checkpoint.get(r) && checkpoint.get(r_to_save) && checkpoint.get(key_dMc)
+                   && checkpoint.get(err) && checkpoint.get(pv) && checkpoint.get(v_temps) && checkpoint.get(v_keyImageNum) && checkpoint.get(v_status) && checkpoint.get(v_stages) && checkpoint.get(v_iterations) && checkpoint.get(v_thresholds)
+                   && checkpoint.get(nbIterationsTotal) && checkpoint.get(nbDeadlineHits) && checkpoint.get(v_hypotheses) && keySwitchPolicy.load(checkpoint)
+                   && checkpoint.get(v_imNumProcessed) && (pv.size() == (unsigned int)nbPass) && (v_imNumProcessed.size() == pv.size());
+        checkpoint.clear();
+        if(!loaded)
+        {
+            std::cout << "no valid checkpoint " << checkpointFile << " for this configuration, starting from image " << i0 << std::endl;
+            imNum = i0;
+            imNumPrev = keyImNum = iRef;
+            nbPass = 0;
+            keySwitch = false;
+            r.set(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+            r_to_save = r;
+            key_dMc.eye();
+            err.clear(); pv.clear(); v_imNumProcessed.clear(); v_temps.clear(); v_keyImageNum.clear(); v_status.clear(); v_stages.clear(); v_iterations.clear(); v_thresholds.clear(); v_hypotheses.clear();
+            nbIterationsTotal = nbDeadlineHits = 0;
+            keySwitchPolicy = KeySwitchPolicy(keyPolicy, seuilErr);
+        }
+        else
+        {
+            //the motion model is a function of the cumulative poses and of the acquisition times of their images only
+            for(unsigned int i = 0 ; i < pv.size() ; i++)
+                predictor.add(pv[i], frameTime(v_imNumProcessed[i], v_frameTimes));
+            
+            //request features set of the key image (odometry: of the previous image), the reference one being already built
+            if((estimationType != 0) && (keyImNum != iRef))
+            {
+                bool poseJacobianReq = (optimLaw == 0);
+                if(!v_imFiles[keyImNum].empty())
+                    vpImageIo::read(I_des, v_imFiles[keyImNum]);
+                IS_des.buildFromTwinOmni(I_des, stereoCam, &Mask);
+                if(so3Corr)
+                {
+                    IS_des.toEquiRect(I_eq, r_eq, ecam, &Mask_eq);
+                    so3Corr->spectrum(I_eq, flm_req);
+                }
+                IS_des.toAbsZN();
+                fSet_req->buildFrom(IS_des, GS, GS_sample, poseJacobianReq);
+                if(featuresSelection > 0.)
+                {
+                    selectSalientFeatures(*fSet_req, dofs, featuresSelection, selectedFeatures);
+                    filterFeatures(*fSet_req, selectedFeatures);
+                }
+                if(optimLaw == 0)
+                    gyro.buildFrom(*fSet_req);
+                else
+                    icGyro.buildFrom(*fSet_req);
+                for(unsigned int l = 0 ; l < pyramid.size() ; l++)
+                {
+                    pyramid[l]->IS_des.buildFromTwinOmni(I_des, stereoCam, &Mask);
+                    pyramid[l]->IS_des.toAbsZN();
+                    pyramid[l]->fSet_req->buildFrom(pyramid[l]->IS_des, pyramid[l]->GS, GS_sample, poseJacobianReq);
+                    if(optimLaw == 0)
+                        pyramid[l]->gyro.buildFrom(*(pyramid[l]->fSet_req));
+                    else
+                        pyramid[l]->icGyro.buildFrom(*(pyramid[l]->fSet_req));
+                }
+                fSet_req_version++;
+            }
+            
+            //desired features set of the last processed image, which the next image may turn into the request one
+            if((estimationType != 0) && (nbPass > 0))
+            {
+                bool poseJacobianDes = poseJacobianCompute || ((estimationType == 2) && (optimLaw == 0) && keySwitch);
+                if(!v_imFiles[imNumPrev].empty())
+                    vpImageIo::read(I_des, v_imFiles[imNumPrev]);
+                IS_des.buildFromTwinOmni(I_des, stereoCam, &Mask);
+                if(so3Corr)
+                {
+                    IS_des.toEquiRect(I_eq, r_eq, ecam, &Mask_eq);
+                    so3Corr->spectrum(I_eq, flm_des);
+                }
+                IS_des.toAbsZN();
+                fSet_des->buildFrom(IS_des, GS, GS_sample, poseJacobianDes);
+                for(unsigned int l = 0 ; l < pyramid.size() ; l++)
+                {
+                    pyramid[l]->IS_des.buildFromTwinOmni(I_des, stereoCam, &Mask);
+                    pyramid[l]->IS_des.toAbsZN();
+                    pyramid[l]->fSet_des->buildFrom(pyramid[l]->IS_des, pyramid[l]->GS, GS_sample, poseJacobianDes);
+                }
+            }
+            std::cout << "resuming from checkpoint " << checkpointFile << " at image " << imNum << " (" << nbPass << " images processed, key image " << keyImNum << ")" << std::endl;
+        }
+    }
+    
+    //the sequential loop is skipped in segment-parallel, frame-parallel and multi-reference modes
+    while(!segmentParallel && !frameParallel && !multiReference && !clickOut && (imNum <= i360))
+    {
+#ifdef COUNT_ALLOCATIONS
+        nbAllocationsPass = nbAllocations;
+        nbApplicationAllocationsPass = nbApplicationAllocations;
+#endif
+        scheduler.wait(imNum);
         temps = vpTime::measureTimeMs();
+        if(budget > 0.)
+            deadline = temps + budget;
         std::cout << "num request image : " << nbPass << std::endl;
         
         switch(estimationType)
@@ -387,21 +2163,141 @@ int main(int argc, char **argv)
                 if(nbPass > 0)
                 {
                     key_dMc.buildFrom(r_to_save);
-                    fSet_req = fSet_des;
-                    gyro.buildFrom(fSet_req);
+                    std::swap(fSet_req, fSet_des); //the former request features set buffer will receive the next desired features set
+                    if(featuresSelection > 0.)
+                    {
+                        selectSalientFeatures(*fSet_req, dofs, featuresSelection, selectedFeatures);
+                        filterFeatures(*fSet_req, selectedFeatures);
+                    }
+                    if(optimLaw == 0)
+                        gyro.buildFrom(*fSet_req);
+                    else
+                        icGyro.buildFrom(*fSet_req);
+                    for(unsigned int l = 0 ; l < pyramid.size() ; l++)
+                    {
+                        std::swap(pyramid[l]->fSet_req, pyramid[l]->fSet_des);
+                        if(optimLaw == 0)
+                            pyramid[l]->gyro.buildFrom(*(pyramid[l]->fSet_req));
+                        else
+                            pyramid[l]->icGyro.buildFrom(*(pyramid[l]->fSet_req));
+                    }
+                    fSet_req_version++;
+                    flm_req.swap(flm_des);
                     r.set(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+                    keyImNum = imNumPrev;
                 }
                 break;
             }
             case 2: //odometrie a images cles
             {
-                if( (nbPass > 0) && (err[nbPass-1] > seuilErr) )
+                if( (nbPass > 0) && keySwitch )
                 {
                     key_dMc.buildFrom(r_to_save);
-                    fSet_req = fSet_des; //check si ce n'est pas encore la precedente !
-                    gyro.buildFrom(fSet_req);
+                    std::swap(fSet_req, fSet_des); //the former request features set buffer will receive the next desired features set
+                    for(unsigned int l = 0 ; l < pyramid.size() ; l++)
+                        std::swap(pyramid[l]->fSet_req, pyramid[l]->fSet_des);
+                    flm_req.swap(flm_des);
                     v_keyImageNum.push_back(nbPass-1);
                     r.set(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+                    keyImNum = imNumPrev;
+                    
+                    if(keyDatabase || rotationAveraging)
+                    {
+                        key = new KeyImage;
+                        key->imageNum = nbPass-1;
+                        key->imageFileNum = keyImNum;
+                        if(so3Corr)
+                            so3Corr->bandEnergies(flm_req, key->signature);
+                        key->cumM = key_dMc;
+                        
+                        //odometry edge of the rotations graph, from the former key image
+                        keyDB[currentKey].cumM.inverse(keyMi);
+                        edge.i = currentKey;
+                        
+                        //re-anchoring to a stored key image if the new one registers to it
+                        int k = keyDatabase ? keyDB.query(key->signature, key_dMc, currentKey) : -1;
+                        bool reanchor = false;
+                        if(k >= 0)
+                        {
+                            //the features set and spectrum of the stored key image are rebuilt from its image in the desired buffers, free until the next image
+                            if(keyDB[k].imageFileNum == iRef)
+                                I_key = I_req;
+                            else if(!v_imFiles[keyDB[k].imageFileNum].empty())
+                                vpImageIo::read(I_key, v_imFiles[keyDB[k].imageFileNum]);
+                            IS_des.buildFromTwinOmni(I_key, stereoCam, &Mask);
+                            IS_des.toEquiRect(I_eq, r_eq, ecam, &Mask_eq);
+                            so3Corr->spectrum(I_eq, flm_des);
+                            IS_des.toAbsZN();
+                            fSet_des->buildFrom(IS_des, GS, GS_sample, optimLaw == 0);
+                            
+                            keyDB[k].cumM.inverse(dMc);
+                            r_best_init.buildFrom(key_dMc*dMc);
+                            double errKey;
+                            if(optimLaw == 0)
+                            {
+                                gyro.buildFrom(*fSet_des);
+                                errKey = gyro.track(*fSet_req, r_best_init, 1.0, robust);
+                            }
+                            else
+                            {
+                                icGyro.buildFrom(*fSet_des);
+                                icGyro.track(*fSet_req, r_best_init, deadline);
+                                errKey = mppSSD(*fSet_des, *fSet_req, r_best_init, robust);
+                            }
+                            reanchor = (errKey < keySwitchPolicy.getThreshold());
+                            std::cout << "key image " << keyDB[k].imageNum << " retrieved, MPP-SSD : " << errKey << (reanchor?" (re-anchored)":"") << std::endl;
+                        }
+                        if(reanchor)
+                        {
+                            //the edge goes to the stored key image, through the new one: R_k = M(r)^-1 key_dMc R_i^-1 R_i
+                            vpHomogeneousMatrix(r_best_init).inverse(dMc);
+                            rotationMatrix(dMc*key_dMc*keyMi, edge.R);
+                            edge.j = k;
+                            v_edges.push_back(edge);
+                            
+                            std::swap(fSet_req, fSet_des);
+                            flm_req.swap(flm_des);
+                            for(unsigned int l = 0 ; l < pyramid.size() ; l++)
+                            {
+                                pyramid[l]->IS_des.buildFromTwinOmni(I_key, stereoCam, &Mask);
+                                pyramid[l]->IS_des.toAbsZN();
+                                pyramid[l]->fSet_req->buildFrom(pyramid[l]->IS_des, pyramid[l]->GS, GS_sample, optimLaw == 0);
+                            }
+                            key_dMc = keyDB[k].cumM;
+                            r = r_best_init;
+                            currentKey = k;
+                            v_reanchors.push_back(nbPass-1);
+                            v_reanchors.push_back(keyDB[k].imageNum);
+                            delete key;
+                        }
+                        else
+                        {
+                            rotationMatrix(key_dMc*keyMi, edge.R);
+                            edge.j = keyDB.size();
+                            v_edges.push_back(edge);
+                            
+                            currentKey = keyDB.size();
+                            keyDB.add(key);
+                        }
+                    }
+                    
+                    if(featuresSelection > 0.)
+                    {
+                        selectSalientFeatures(*fSet_req, dofs, featuresSelection, selectedFeatures);
+                        filterFeatures(*fSet_req, selectedFeatures);
+                    }
+                    if(optimLaw == 0)
+                        gyro.buildFrom(*fSet_req);
+                    else
+                        icGyro.buildFrom(*fSet_req);
+                    for(unsigned int l = 0 ; l < pyramid.size() ; l++)
+                    {
+                        if(optimLaw == 0)
+                            pyramid[l]->gyro.buildFrom(*(pyramid[l]->fSet_req));
+                        else
+                            pyramid[l]->icGyro.buildFrom(*(pyramid[l]->fSet_req));
+                    }
+                    fSet_req_version++;
                 }
                 break;
             }
@@ -411,145 +2307,320 @@ int main(int argc, char **argv)
             }
         }
         
-        sprintf(myFilter, "%06d.*\\.%s", imNum, ext);
-        
-        my_filter.set_expression(myFilter);
+        //the predicted cumulative pose is expressed with respect to the current request image
+        predicted = predictor.predict(M_pred, frameTime(imNum, v_frameTimes));
+        if(predicted)
+        {
+            key_dMc.inverse(dMc);
+            M_pred = M_pred*dMc;
+            r_pred.buildFrom(M_pred);
+            r = r_pred;
+            std::cout << "r predicted : " << PoseRow{r} << std::endl;
+        }
         
-        for (boost::filesystem::directory_iterator iter(dir),end; iter!=end; ++iter)
+        //the inertial rates are integrated from the previous image (from the reference one for the first image), composed with its estimated cumulative pose
+        imuPredicted = false;
+        if(imuPrior)
         {
-            name = iter->path().leaf().string();
-            if (boost::regex_match(name, my_filter))
+            if((imNumPrev < v_frameTimes.size()) && (imNum < v_frameTimes.size()) && imu.integrate(v_frameTimes[imNumPrev], v_frameTimes[imNum], dM_imu))
             {
-                std::cout << iter->path().string() << " loaded" << std::endl;
-                vpImageIo::read(I_des, iter->path().string());
-                break;
+                cumMd = (nbPass == 0) ? dM_imu : dM_imu*vpHomogeneousMatrix(pv.back());
+                key_dMc.inverse(dMc);
+                M_pred = cumMd*dMc;
+                r_pred.buildFrom(M_pred);
+                r = r_pred;
+                predicted = imuPredicted = true;
+                std::cout << "r IMU : " << PoseRow{r} << std::endl;
             }
         }
-        if(nbPass == 0)
+        if(optimLaw != 0)
+        {
+            icGyro.setPrior(imuPredicted ? &r_pred : NULL);
+            for(unsigned int l = 0 ; l < pyramid.size() ; l++)
+                pyramid[l]->icGyro.setPrior(imuPredicted ? &r_pred : NULL);
+        }
+        
+        if(!v_imFiles[imNum].empty())
+        {
+            std::cout << v_imFiles[imNum] << " loaded" << std::endl;
+            vpImageIo::read(I_des, v_imFiles[imNum]);
+        }
+        if(!disp2.isInitialised())
             disp2.init(I_des, 500, 50, "I_des");
 
         vpDisplay::display(I_des);
         vpDisplay::flush(I_des);
         
         // Desired feature set setting from the current image
-        prRegularlySampledCSImage<unsigned char> IS_des(subdivLevel);
-        IS_des.setInterpType(prInterpType::IMAGEPLANE_BILINEAR);
         IS_des.buildFromTwinOmni(I_des, stereoCam, &Mask);
+        if(so3Corr)
+        {
+            IS_des.toEquiRect(I_eq, r_eq, ecam, &Mask_eq);
+            so3Corr->spectrum(I_eq, flm_des);
+        }
         IS_des.toAbsZN();
         
         //calculer en parallele un fSet_des avec lambda_g /= 10 pour les dernières itérations --> précision accrue, sans perdre de temps
-        fSet_des.buildFrom(IS_des, GS, GS_sample, poseJacobianCompute); // Goulot !
-        std::cout << "nb features : " << fSet_des.set.size() << std::endl;
+        fSet_des->buildFrom(IS_des, GS, GS_sample, poseJacobianCompute); // Goulot !
+        std::cout << "nb features : " << fSet_des->set.size() << std::endl;
+        
+        //the request features selection applies to the desired features set as well (the full set is kept to become the next request one), copied to a buffer reused from one image to the next
+        if(featuresSelection > 0.)
+        {
+            if(!fSet_des_selBuilt)
+            {
+                fSet_des_sel = *fSet_des;
+                fSet_des_selBuilt = true;
+            }
+            APPLICATION_BUFFERS;
+            selectFeatures(*fSet_des, selectedFeatures, fSet_des_sel);
+        }
+        MPPFeaturesSet &fSet_des_track = (featuresSelection > 0.) ? fSet_des_sel : *fSet_des;
+        
+        for(unsigned int l = 0 ; l < pyramid.size() ; l++)
+        {
+            pyramid[l]->IS_des.buildFromTwinOmni(I_des, stereoCam, &Mask);
+            pyramid[l]->IS_des.toAbsZN();
+            pyramid[l]->fSet_des->buildFrom(pyramid[l]->IS_des, pyramid[l]->GS, GS_sample, poseJacobianCompute);
+        }
+        
+        //the initial guesses are evaluated on the coarsest level of the pyramid
+        MPPFeaturesSet *fSet_req_init = pyramid.empty() ? fSet_req : pyramid[0]->fSet_req;
+        MPPFeaturesSet &fSet_des_init = pyramid.empty() ? fSet_des_track : *(pyramid[0]->fSet_des);
         
         // if there is a file provided as initial poses, they are used instead of other strategies
-        if(ficInit)
+        v_r_hyp.clear();
+        if(ficInit && ((imNum-i0)/iStep < v_pv_init.size()))
         {
-            r = v_pv_init[nbPass];
-            std::cout << "r init : " << r.t() << std::endl;
+            r = v_pv_init[(imNum-i0)/iStep];
+            std::cout << "r init : " << PoseRow{r} << std::endl;
         }
         else
         {
-            // trying to select the best initial 3D orientation guess
-            if(nbTries > 1)
+            // trying to select the best initial 3D orientation guess, unless the inertial rates give it
+            if(imuPredicted)
             {
-                vpPoseVector r_best_init;
-                double err_min_init = 1e20;
-                double angle[3]={0,0,0}, pasAngulaire;
-                vpHomogeneousMatrix dMc;
-                double err0;
-                pasAngulaire = 2.0*M_PI / nbTries;
-
-                unsigned int nbTriesPerDOF[3] = {1,1,1};
-                if(dofs[3])
-                {
-                    nbTriesPerDOF[0] = nbTries;
-                    angle[0] = -pasAngulaire*floor(nbTries*0.5);
-                }
-                if(dofs[4])
-                {
-                    nbTriesPerDOF[1] = 1;//nbTries;
-                    angle[1] = -pasAngulaire*floor(nbTries*0.5);
-                }
-                if(dofs[5])
+                r_best_init = r;
+            }
+            else if(!v_hypotheses.empty())
+            {
+                //hypotheses of the previous image, expressed with respect to the current request image, and the current guess (predicted or not)
+                key_dMc.inverse(dMc);
+                for(unsigned int h = 0 ; h < v_hypotheses.size() ; h++)
+                    v_r_hyp.push_back(vpPoseVector(v_hypotheses[h]*dMc));
+                v_r_hyp.push_back(r);
+                if(optimLaw == 0)
+                    r = r_best_init = bestHypothesis(pool, v_r_hyp, *fSet_req_init, fSet_req_version, fSet_des_init, s_des_f, v_tries, robust, floatSSD, &v_err_hyp, deadline);
+                else
+                    r = r_best_init = v_r_hyp[refineHypotheses(pool, v_r_hyp, v_err_hyp, pyramid.empty() ? icGyro : pyramid[0]->icGyro, fSet_req_version, fSet_des_init, nbPass, v_refinements, deadline)];
+            }
+            else if(initType == 2)
+            {
+                //the correlation maxima, compared thanks to the MPP-SSD: at the optimum, I_des(X) = I_req(R^T X) with R the rotation of r, which is the rotation of the maxima of the correlation of the desired image with the request one
+                so3Corr->peaks(flm_des, flm_req, SO3_FFT_NB_PEAKS, v_r_tries);
+                if(predicted)
+                    v_r_tries.push_back(r_pred);
+                r = r_best_init = bestHypothesis(pool, v_r_tries, *fSet_req_init, fSet_req_version, fSet_des_init, s_des_f, v_tries, robust, floatSSD, NULL, deadline);
+            }
+            else if((nbTries > 1) && (initType == 1) && dofs[3] && dofs[4] && dofs[5])
+            {
+                r = r_best_init = so3HierarchicalSearch(pool, nbTries, *fSet_req_init, fSet_req_version, fSet_des_init, s_des_f, v_tries, robust, floatSSD, deadline);
+            }
+            else if(nbTries > 1)
+            {
+                rotationGrid(nbTries, dofs, v_r_tries);
+                //the grid is centered on the predicted orientation
+                if(predicted)
+                    for(unsigned int i = 0 ; i < v_r_tries.size() ; i++)
+                    {
+                        dMc.buildFrom(v_r_tries[i]);
+                        v_r_tries[i].buildFrom(dMc*M_pred);
+                    }
+                
+                r = r_best_init = bestHypothesis(pool, v_r_tries, *fSet_req_init, fSet_req_version, fSet_des_init, s_des_f, v_tries, robust, floatSSD, NULL, deadline);
+            }
+        }
+        
+        // register the request feature set over the desired one, from the coarsest to the finest subdivision level, and save the optimal MPP-SSD
+        // no stage starts once the deadline is over, or is expected to be over before its end
+        deadlineHit = false;
+        nbStagesDone = 0;
+        nbIterationsImage = 0;
+        for(unsigned int l = 0 ; (l < pyramid.size()) && !deadlineHit ; l++)
+        {
+            deadlineHit = !stageFits(l);
+            if(!deadlineHit)
+            {
+                tStage = vpTime::measureTimeMs();
+                if(optimLaw == 0)
                 {
-                    nbTriesPerDOF[2] = 1;//nbTries;
-                    angle[2] = -pasAngulaire*floor(nbTries*0.5);
+                    pyramid[l]->gyro.track(*(pyramid[l]->fSet_des), r, 1.0, robust);
+                    stageDone(l);
                 }
-                for(int iTry0 = 0 ; iTry0 < nbTriesPerDOF[0] ; iTry0++, angle[0]+=pasAngulaire)
+                else
                 {
-                    r[3] = angle[0];
-                    if(dofs[4])
-                        angle[1] = -pasAngulaire*floor(nbTries*0.5);
-                    else
-                        angle[1] = 0;
-                    for(int iTry1 = 0 ; iTry1 < nbTriesPerDOF[1] ; iTry1++, angle[1]+=pasAngulaire)
-                    {
-                        r[4] = angle[1];
-                        if(dofs[5])
-                            angle[2] = -pasAngulaire*floor(nbTries*0.5);
-                        else
-                            angle[2] = 0;
-                        for(int iTry2 = 0 ; iTry2 < nbTriesPerDOF[2] ; iTry2++, angle[2]+=pasAngulaire)
-                        {
-                            r[5] = angle[2];
-                            
-                            dMc.buildFrom(r);
-                            fSet_req.update(dMc);
-                            
-                            prSSDCmp<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec> > errorComputer(fSet_req, fSet_des, robust);
-                            prPhotometricGMS<prCartesian3DPointVec> GS_error = errorComputer.getRobustCost();
-                            err0 = GS_error.getGMS();
-                            
-                            if(err0 < err_min_init)
-                            {
-                                err_min_init = err0;
-                                r_best_init = r;
-                            }
-                        }
-                    }
+                    deadlineHit = (pyramid[l]->icGyro.track(*(pyramid[l]->fSet_des), r, deadline) == MPPGyroIC::DEADLINE);
+                    nbIterationsImage += pyramid[l]->icGyro.getNbIterations();
                 }
-                r = r_best_init;
+                nbStagesDone++;
             }
         }
-        
-        // register the request feature set over the desired one and save the optimal MPP-SSD
-        err.push_back(gyro.track(fSet_des, r, 1.0, robust));
+        if(!deadlineHit)
+            deadlineHit = !stageFits(pyramid.size());
+        if(!deadlineHit)
+        {
+            tStage = vpTime::measureTimeMs();
+            if(optimLaw == 0)
+            {
+                err.push_back(gyro.track(fSet_des_track, r, 1.0, robust));
+                stageDone(pyramid.size());
+            }
+            else
+            {
+                deadlineHit = (icGyro.track(fSet_des_track, r, deadline) == MPPGyroIC::DEADLINE);
+                nbIterationsImage += icGyro.getNbIterations();
+                err.push_back(mppSSD(*fSet_req, fSet_des_track, r, robust));
+            }
+            nbStagesDone++;
+        }
+        else
+        {
+            //no tracking stage done: the initial guess is not trusted, the pose of the previous image (with respect to the current request image) is kept, if any
+            if((nbStagesDone == 0) && (nbPass > 0))
+            {
+                key_dMc.inverse(dMc);
+                r.buildFrom(vpHomogeneousMatrix(pv.back())*dMc);
+            }
+            //best orientation found so far, its MPP-SSD being computed at the finest level
+            err.push_back(mppSSD(*fSet_req, fSet_des_track, r, robust));
+        }
+        if(deadlineHit)
+        {
+            nbDeadlineHits++;
+            std::cout << "deadline hit after " << nbStagesDone << " tracking stages" << ((nbStagesDone == 0) ? ", pose of the previous image kept" : "") << std::endl;
+        }
+        v_status.push_back(deadlineHit ? ((nbStagesDone == 0) ? 2 : 1) : 0);
+        v_stages.push_back(nbStagesDone);
+        if(optimLaw != 0)
+        {
+            v_iterations.push_back(nbIterationsImage);
+            std::cout << ((optimLaw == 1)?"inverse compositional":"ESM") << " iterations : " << nbIterationsImage << std::endl;
+        }
     
+        nbIterationsTotal += nbIterationsImage;
+        
+        if(estimationType == 2)
+        {
+            keySwitch = keySwitchPolicy.decide(err[nbPass], nbIterationsImage, r);
+            v_thresholds.push_back(keySwitchPolicy.getThreshold());
+        }
+        //the current image becomes the key image: its features sets (every pyramid level) are built again from IS_des, with the pose Jacobian gyro.buildFrom needs,
+        //by the very call of an eager build, so that the promoted sets are those an eager build gives
+        if((estimationType == 2) && (optimLaw == 0) && keySwitch)
+        {
+            fSet_des->buildFrom(IS_des, GS, GS_sample, true);
+            for(unsigned int l = 0 ; l < pyramid.size() ; l++)
+                pyramid[l]->fSet_des->buildFrom(pyramid[l]->IS_des, pyramid[l]->GS, GS_sample, true);
+        }
+
         v_temps.push_back(vpTime::measureTimeMs()-temps);
         std::cout << "Pass " << nbPass << " time : " << v_temps[nbPass] << " ms" << std::endl;
         
         dMd_prec.buildFrom(r);
         r_to_save.buildFrom(dMd_prec*key_dMc);
         pv.push_back(r_to_save);
+        v_imNumProcessed.push_back(imNum);
+        predictor.add(r_to_save, frameTime(imNum, v_frameTimes));
+        if(rotationAveraging)
+            v_imageKey.push_back(currentKey);
         
-        std::cout << "Pose optim : " << r.t() << " cum : " << r_to_save.t() << std::endl;
+        //hypotheses of the next image: the estimated orientation, then the other hypotheses of the current image by increasing cost, MH_MIN_ANGLE apart at least
+        if(nbHypotheses > 0)
+        {
+            v_hypotheses.clear();
+            v_hypotheses.push_back(vpHomogeneousMatrix(r_to_save));
+            hypOrder.resize(v_r_hyp.size());
+            for(unsigned int i = 0 ; i < hypOrder.size() ; i++)
+                hypOrder[i] = i;
+            std::stable_sort(hypOrder.begin(), hypOrder.end(), [&v_err_hyp](unsigned int a, unsigned int b) { return v_err_hyp[a] < v_err_hyp[b]; });
+            for(unsigned int i = 0 ; (i < hypOrder.size()) && (v_hypotheses.size() < nbHypotheses) ; i++)
+            {
+                cumMd = vpHomogeneousMatrix(v_r_hyp[hypOrder[i]])*key_dMc;
+                bool distinct = true;
+                for(unsigned int h = 0 ; (h < v_hypotheses.size()) && distinct ; h++)
+                {
+                    r_dist.buildFrom(cumMd.inverse()*v_hypotheses[h]);
+                    distinct = (sqrt(r_dist[3]*r_dist[3] + r_dist[4]*r_dist[4] + r_dist[5]*r_dist[5]) >= MH_MIN_ANGLE);
+                }
+                if(distinct)
+                    v_hypotheses.push_back(cumMd);
+            }
+        }
+        
+        std::cout << "Pose optim : " << PoseRow{r} << " cum : " << PoseRow{r_to_save} << std::endl;
         
         std::cout << "weighted FPP-SSD : " << err[nbPass] << std::endl;
         
         clickOut=vpDisplay::getClick(I_req,false);
         
-        vpImage<unsigned char> I_r(I_des.getHeight(), I_des.getWidth());
+        if((I_r.getHeight() != I_des.getHeight()) || (I_r.getWidth() != I_des.getWidth()))
+            I_r.resize(I_des.getHeight(), I_des.getWidth());
         if(stabilisation)
         {
-            vpPoseVector ir;
-            ir.buildFrom(vpHomogeneousMatrix(r_to_save).inverse());
+            cumMd.buildFrom(r_to_save);
+            cumMd.inverse(dMc);
+            ir.buildFrom(dMc);
             IS_des.toTwinOmni(I_r, ir, stereoCam, &Mask);
         }
         else
         {
             IS_req.toTwinOmni(I_r, r, stereoCam, &Mask);
         }
-        s.str("");
-        s.setf(std::ios::right, std::ios::adjustfield);
-        s << chemin << "/rotComp/" << std::setfill('0') << std::setw(6) << imNum << ".png";
-        filename = s.str();
+        snprintf(ficRotComp, FILENAME_MAX, "%s/rotComp/%06d.png", chemin, imNum);
+        filename.assign(ficRotComp);
         vpImageIo::write(I_r, filename);
         
-        imNum+=iStep;
+        imNumPrev = imNum;
+        imNum = scheduler.next(imNum);
         nbPass++;
+        
+        //checkpoint of the state of the next image, serialized here and written by the writing thread
+        if(checkpointWriter && ((nbPass % checkpointPeriod) == 0))
+        {
+            tCheckpoint = vpTime::measureTimeMs();
+            checkpoint.clear();
+            checkpoint.put(CHECKPOINT_MAGIC); checkpoint.put(CHECKPOINT_VERSION);
+            checkpoint.put(estimationType); checkpoint.put(optimLaw); checkpoint.put(iRef); checkpoint.put(i0); checkpoint.put(i360); checkpoint.put(iStep); checkpoint.put(subdivLevel); checkpoint.put(lambda_g);
+            checkpoint.put(imNum); checkpoint.put(imNumPrev); checkpoint.put(keyImNum); checkpoint.put(nbPass); checkpoint.put(keySwitch);
+            checkpoint.put(r); checkpoint.put(r_to_save); checkpoint.put(key_dMc);
+            checkpoint.put(err); checkpoint.put(pv); checkpoint.put(v_temps); checkpoint.put(v_keyImageNum); checkpoint.put(v_status); checkpoint.put(v_stages); checkpoint.put(v_iterations); checkpoint.put(v_thresholds);
+            checkpoint.put(nbIterationsTotal); checkpoint.put(nbDeadlineHits); checkpoint.put(v_hypotheses); keySwitchPolicy.save(checkpoint);
+            checkpoint.put(v_imNumProcessed);
+            checkpointWriter->post(checkpoint);
+            std::cout << "checkpoint at image " << imNum << " serialized in " << vpTime::measureTimeMs()-tCheckpoint << " ms" << std::endl;
+        }
+        
+#ifdef COUNT_ALLOCATIONS
+        v_allocations.push_back(nbAllocations - nbAllocationsPass);
+        std::cout << "Pass " << nbPass-1 << " heap allocations : " << v_allocations.back() << " (application buffers : " << (nbApplicationAllocations - nbApplicationAllocationsPass) << ")" << std::endl;
+        //steady state: the application buffers are allocated at the first image, then reused
+        if((nbPass > 1) && (nbApplicationAllocations != nbApplicationAllocationsPass))
+        {
+            nbApplicationAllocationsFailures++;
+            std::cout << "Pass " << nbPass-1 << " allocation check failed: " << (nbApplicationAllocations - nbApplicationAllocationsPass) << " heap allocations of the application buffers" << std::endl;
+        }
+#endif
         //angle += 2.5*M_PI/180.;
     }
     
+    //the last checkpoint is written before the writing thread stops
+    if(checkpointWriter)
+    {
+        delete checkpointWriter;
+        checkpointWriter = NULL;
+        std::cout << "checkpoints written to " << checkpointFile << std::endl;
+    }
+    
     // 4. Save the MMP-SSD at optimal poses, optimal poses, processing times and key images numbers to files
     
     //save err list to file
@@ -565,6 +2636,124 @@ int main(int argc, char **argv)
     }
     ficerrMin.close();
     
+    //rotation averaging over the key images: the graph of the odometry relative rotations is completed by registering every key image to earlier ones (inverse compositional law, in parallel over the request key images),
+    //then the poses of the images are expressed with respect to the robustly averaged rotations of their key images, the raw poses being saved to poses_raw_*.txt
+    std::vector<vpPoseVector> pv_raw;
+    if(rotationAveraging && (keyDB.size() > 1))
+    {
+        double tRA = vpTime::measureTimeMs();
+        unsigned int nbKeys = keyDB.size(), nbOdometryEdges = v_edges.size();
+        
+        //every key image j is registered to its RA_NB_NEIGHBOURS earlier key images of closest orientation (within KEYS_MAX_ANGLE) not yet linked to it
+        std::vector<std::vector<unsigned int> > v_linked(nbKeys), v_neighbours(nbKeys);
+        for(unsigned int e = 0 ; e < v_edges.size() ; e++)
+        {
+            v_linked[v_edges[e].i].push_back(v_edges[e].j);
+            v_linked[v_edges[e].j].push_back(v_edges[e].i);
+        }
+        std::vector<char> isLinked(nbKeys, 0);
+        std::vector<std::pair<double, unsigned int> > candidates;
+        double traceMin = 1. + 2.*cos(KEYS_MAX_ANGLE);
+        for(unsigned int j = 1 ; j < nbKeys ; j++)
+        {
+            for(unsigned int a = 0 ; a < v_linked[j].size() ; a++)
+                isLinked[v_linked[j][a]] = 1;
+            candidates.clear();
+            for(unsigned int i = 0 ; i < j ; i++)
+            {
+                if(isLinked[i])
+                    continue;
+                double trace = 0.;
+                for(unsigned int k = 0 ; k < 9 ; k++)
+                    trace += keyDB[i].R[k]*keyDB[j].R[k];
+                if(trace >= traceMin)
+                    candidates.push_back(std::make_pair(-trace, i));
+            }
+            unsigned int nbNeighbours = std::min((unsigned int)candidates.size(), (unsigned int)RA_NB_NEIGHBOURS);
+            std::partial_sort(candidates.begin(), candidates.begin()+nbNeighbours, candidates.end());
+            for(unsigned int c = 0 ; c < nbNeighbours ; c++)
+                v_neighbours[candidates[c].second].push_back(j);
+            for(unsigned int a = 0 ; a < v_linked[j].size() ; a++)
+                isLinked[v_linked[j][a]] = 0;
+        }
+        
+        //one task per request key image, its Jacobian and Gauss-Newton matrix being computed once for all its registrations, the edges being kept if their MPP-SSD is lower than the key image switching threshold
+        std::vector<unsigned int> v_tasks;
+        for(unsigned int i = 0 ; i < nbKeys ; i++)
+            if(!v_neighbours[i].empty())
+                v_tasks.push_back(i);
+        std::vector<std::vector<RotationEdge> > v_taskEdges(v_tasks.size());
+        //the features sets of the key images are rebuilt from their images by every thread, with its own stereo rig model and mask
+        std::vector<MPPGyroIC> v_icGyro(pool.size(), icGyro);
+        std::vector<MPPFeaturesSet> v_fSet_req(pool.size()), v_fSet_des(pool.size());
+        std::vector<TwinOmniSampler *> v_samplers(pool.size());
+        for(unsigned int t = 0 ; t < pool.size() ; t++)
+            v_samplers[t] = new TwinOmniSampler(argv[1], Mask, subdivLevel, lambda_g);
+        auto keyFeatures = [&](unsigned int k, unsigned int t, MPPFeaturesSet &fSet)
+        {
+            TwinOmniSampler &sampler = *v_samplers[t];
+            if(keyDB[k].imageFileNum == iRef)
+                sampler.I = I_req;
+            else if(!v_imFiles[keyDB[k].imageFileNum].empty())
+                vpImageIo::read(sampler.I, v_imFiles[keyDB[k].imageFileNum]);
+            sampler.buildFrom(sampler.I, fSet, false);
+        };
+        double seuilPair = keySwitchPolicy.getThreshold();
+        pool.parallelFor(v_tasks.size(), [&](unsigned int n, unsigned int t)
+        {
+            unsigned int i = v_tasks[n];
+            RotationEdge pairEdge;
+            vpHomogeneousMatrix Mi;
+            vpPoseVector r_ij;
+            keyDB[i].cumM.inverse(Mi);
+            keyFeatures(i, t, v_fSet_req[t]);
+            v_icGyro[t].buildFrom(v_fSet_req[t]);
+            for(unsigned int a = 0 ; a < v_neighbours[i].size() ; a++)
+            {
+                unsigned int j = v_neighbours[i][a];
+                keyFeatures(j, t, v_fSet_des[t]);
+                r_ij.buildFrom(keyDB[j].cumM*Mi);
+                v_icGyro[t].track(v_fSet_des[t], r_ij);
+                if(mppSSD(v_fSet_req[t], v_fSet_des[t], r_ij, robust) < seuilPair)
+                {
+                    pairEdge.i = i;
+                    pairEdge.j = j;
+                    rotationMatrix(vpHomogeneousMatrix(r_ij), pairEdge.R);
+                    v_taskEdges[n].push_back(pairEdge);
+                }
+            }
+        });
+        for(unsigned int t = 0 ; t < pool.size() ; t++)
+            delete v_samplers[t];
+        for(unsigned int n = 0 ; n < v_taskEdges.size() ; n++)
+            v_edges.insert(v_edges.end(), v_taskEdges[n].begin(), v_taskEdges[n].end());
+        
+        std::vector<double> v_R(9*nbKeys), v_w;
+        for(unsigned int k = 0 ; k < nbKeys ; k++)
+            for(unsigned int m = 0 ; m < 9 ; m++)
+                v_R[9*k+m] = keyDB[k].R[m];
+        unsigned int nbIterations = averageRotations(v_edges, v_R, v_w);
+        unsigned int nbOutliers = 0;
+        for(unsigned int e = 0 ; e < v_w.size() ; e++)
+            if(v_w[e] < 0.5)
+                nbOutliers++;
+        
+        //pose of every image with respect to its key image, composed with the refined rotation of the key image
+        std::vector<vpHomogeneousMatrix> v_keyM(nbKeys);
+        for(unsigned int k = 0 ; k < nbKeys ; k++)
+            for(unsigned int a = 0 ; a < 3 ; a++)
+                for(unsigned int b = 0 ; b < 3 ; b++)
+                    v_keyM[k][a][b] = v_R[9*k+3*a+b];
+        pv_raw = pv;
+        for(unsigned int i = 0 ; (i < pv.size()) && (i < v_imageKey.size()) ; i++)
+        {
+            keyDB[v_imageKey[i]].cumM.inverse(keyMi);
+            pv[i].buildFrom(vpHomogeneousMatrix(pv_raw[i])*keyMi*v_keyM[v_imageKey[i]]);
+        }
+        
+        std::cout << "rotation averaging over " << nbKeys << " key images : " << nbOdometryEdges << " odometry and " << v_edges.size()-nbOdometryEdges << " pairwise relative rotations (" << nbOutliers << " outliers), " << nbIterations << " iterations, " << vpTime::measureTimeMs()-tRA << " ms" << std::endl;
+    }
+    
     //save poses list to file
     s.str("");
     s.setf(std::ios::right, std::ios::adjustfield);
@@ -578,6 +2767,21 @@ int main(int argc, char **argv)
     }
     ficPoses.close();
     
+    //save the raw poses list (before rotation averaging) to file
+    if(!pv_raw.empty())
+    {
+        s.str("");
+        s.setf(std::ios::right, std::ios::adjustfield);
+        s << chemin << "/poses_raw_" << iRef << "_" << i0 << "_" << i360 << ".txt";
+        filename = s.str();
+        std::ofstream ficPosesRaw(filename.c_str());
+        for(unsigned int i = 0 ; i < pv_raw.size() ; i++)
+        {
+            ficPosesRaw << pv_raw[i].t() << std::endl;
+        }
+        ficPosesRaw.close();
+    }
+    
     //save times list to file
     s.str("");
     s.setf(std::ios::right, std::ios::adjustfield);
@@ -604,5 +2808,138 @@ int main(int argc, char **argv)
     }
     ficKeys.close();
     
+    //save the key image switching threshold of every image to file, with the numbers of key images and iterations (those of the inverse compositional and ESM laws) of the policy
+    if(estimationType == 2)
+    {
+        std::cout << "key image switching policy " << keyPolicy << " : " << v_keyImageNum.size() << " key image switches, " << nbIterationsTotal << " iterations" << std::endl;
+        
+        s.str("");
+        s.setf(std::ios::right, std::ios::adjustfield);
+        s << chemin << "/keyswitch_" << iRef << "_" << i0 << "_" << i360 << ".txt";
+        filename = s.str();
+        std::ofstream ficKeySwitch(filename.c_str());
+        for(unsigned int i = 0 ; i < v_thresholds.size() ; i++)
+        {
+            ficKeySwitch << err[i] << " " << v_thresholds[i] << std::endl;
+        }
+        ficKeySwitch.close();
+    }
+    
+    //save the re-anchorings to stored key images (image number, key image number, -1 for the reference image) to file
+    if(keyDatabase)
+    {
+        std::cout << keyDB.size() << " key images stored, " << v_reanchors.size()/2 << " re-anchorings" << std::endl;
+        
+        s.str("");
+        s.setf(std::ios::right, std::ios::adjustfield);
+        s << chemin << "/reanchors_" << iRef << "_" << i0 << "_" << i360 << ".txt";
+        filename = s.str();
+        std::ofstream ficReanchors(filename.c_str());
+        for(unsigned int i = 0 ; i+1 < v_reanchors.size() ; i+=2)
+        {
+            ficReanchors << v_reanchors[i] << " " << v_reanchors[i+1] << std::endl;
+        }
+        ficReanchors.close();
+    }
+    
+    //save the end-to-end latency of every processed image (image number, latency in ms) to file, with the number of dropped images
+    if(scheduler.isRealTime())
+    {
+        const std::vector<unsigned int> &v_latencyImNum = scheduler.getImageNumbers();
+        const std::vector<double> &v_latencies = scheduler.getLatencies();
+        double meanLatency = 0., maxLatency = 0.;
+        for(unsigned int i = 0 ; i < v_latencies.size() ; i++)
+        {
+            meanLatency += v_latencies[i];
+            maxLatency = std::max(maxLatency, v_latencies[i]);
+        }
+        if(!v_latencies.empty())
+            meanLatency /= v_latencies.size();
+        std::cout << "real-time scheduling policy " << schedulePolicy << " : " << v_latencies.size() << " images processed, " << scheduler.getNbDropped() << " dropped, mean latency " << meanLatency << " ms, max latency " << maxLatency << " ms" << std::endl;
+        
+        s.str("");
+        s.setf(std::ios::right, std::ios::adjustfield);
+        s << chemin << "/latency_" << iRef << "_" << i0 << "_" << i360 << ".txt";
+        filename = s.str();
+        std::ofstream ficLatency(filename.c_str());
+        for(unsigned int i = 0 ; i < v_latencies.size() ; i++)
+        {
+            ficLatency << v_latencyImNum[i] << " " << v_latencies[i] << std::endl;
+        }
+        ficLatency.close();
+    }
+    
+    //save the iterations of the inverse compositional or ESM law to file (those of gyro.track are saved to iter_*.txt), with the mean iterations and time per image
+    if(optimLaw != 0)
+    {
+        double meanIterations = 0., meanTime = 0.;
+        for(unsigned int i = 0 ; i < v_iterations.size() ; i++)
+        {
+            meanIterations += v_iterations[i];
+            meanTime += v_temps[i];
+        }
+        if(!v_iterations.empty())
+        {
+            meanIterations /= v_iterations.size();
+            meanTime /= v_iterations.size();
+        }
+        std::cout << ((optimLaw == 1)?"inverse compositional":"ESM") << " law : " << meanIterations << " iterations and " << meanTime << " ms per image on average" << std::endl;
+        
+        s.str("");
+        s.setf(std::ios::right, std::ios::adjustfield);
+        s << chemin << "/iterations_" << iRef << "_" << i0 << "_" << i360 << ".txt";
+        filename = s.str();
+        std::ofstream ficIterations(filename.c_str());
+        for(unsigned int i = 0 ; i < v_iterations.size() ; i++)
+        {
+            ficIterations << v_iterations[i] << std::endl;
+        }
+        ficIterations.close();
+    }
+    
+    //save the time budget status (0 every stage done, 1 deadline hit after some tracking stages, 2 before any, 3 image file missing) and number of tracking stages done of every image to file
+    if((budget > 0.) || (nbMissingImages > 0))
+    {
+        std::cout << "deadline hit for " << nbDeadlineHits << " images out of " << nbPass << std::endl;
+        
+        s.str("");
+        s.setf(std::ios::right, std::ios::adjustfield);
+        s << chemin << "/status_" << iRef << "_" << i0 << "_" << i360 << ".txt";
+        filename = s.str();
+        std::ofstream ficStatus(filename.c_str());
+        for(unsigned int i = 0 ; i < v_status.size() ; i++)
+        {
+            ficStatus << v_status[i] << " " << v_stages[i] << std::endl;
+        }
+        ficStatus.close();
+    }
+    
+    for(unsigned int l = 0 ; l < pyramid.size() ; l++)
+        delete pyramid[l];
+    if(so3Corr)
+        delete so3Corr;
+    
+#ifdef COUNT_ALLOCATIONS
+    //heap allocations of the whole loop body after the first image (steady state), libPeR and ViSP included
+    unsigned long nbAllocationsMin = std::numeric_limits<unsigned long>::max(), nbAllocationsMax = 0, nbAllocationsTotal = 0;
+    for(unsigned int i = 1 ; i < v_allocations.size() ; i++)
+    {
+        nbAllocationsTotal += v_allocations[i];
+        nbAllocationsMin = std::min(nbAllocationsMin, v_allocations[i]);
+        nbAllocationsMax = std::max(nbAllocationsMax, v_allocations[i]);
+    }
+    if(v_allocations.size() > 1)
+        std::cout << "steady state heap allocations : " << nbAllocationsTotal << " over " << v_allocations.size()-1 << " images (" << (double)nbAllocationsTotal/(v_allocations.size()-1) << " per image, min " << nbAllocationsMin << ", max " << nbAllocationsMax << ")" << std::endl;
+    std::cout << "application buffers allocating after the first image : " << nbApplicationAllocationsFailures << " images" << std::endl;
+    if(nbApplicationAllocationsFailures > 0)
+        return 1;
+#endif
+    
+#ifdef CHECK_FLOAT_SSD
+    std::cout << "float SSD check : " << nbFloatSSDFailures << " of " << nbFloatSSDChecks << " selections beyond " << FLOAT_SSD_TOLERANCE << " deg" << std::endl;
+    if(nbFloatSSDFailures > 0)
+        return 1;
+#endif
+    
 	return 0;
 }
@@ -0,0 +1,271 @@
+/*!
+ \file MPPSSDkernels.h
+ \brief Single precision kernels of the MPP-SSD (SSD, residuals and dot products accumulated by blocks) and of the Tukey M-estimator (scale by median absolute deviation, weights and robust cost),
+ * vectorized with AVX-512 or AVX2 when the compiler enables them
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef MPPSSDkernels_h
+#define MPPSSDkernels_h
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+//number of features accumulated in single precision before being added to the double precision sum
+#define SSD_BLOCK_SIZE 1024
+
+//Tukey M-estimator of the application-side laws and of the single precision MPP-SSD: constant (in scale units) and MAD to standard deviation factor
+#define TUKEY_C 4.6851f
+#define MAD_TO_SIGMA 1.4826f
+//maximum number of residuals (regularly subsampled) of the scale estimation
+#define ROBUST_SCALE_SAMPLES 4096
+
+/*!
+ * \fn template<typename FeaturesSetType> void featuresValues(FeaturesSetType &fSet, std::vector<float> &values)
+ * \brief Copies the photometric potentials of a features set to a single precision buffer (the buffer is reused from one call to another)
+ */
+template<typename FeaturesSetType>
+void featuresValues(FeaturesSetType &fSet, std::vector<float> &values)
+{
+    values.resize(fSet.set.size());
+    for(unsigned int i = 0 ; i < fSet.set.size() ; i++)
+        values[i] = fSet.set[i].getGMS();
+}
+
+#if defined(__AVX2__) && !defined(__AVX512F__)
+/*!
+ * \fn float horizontalSum(__m256 acc)
+ * \brief Sum of the 8 lanes of acc
+ */
+inline float horizontalSum(__m256 acc)
+{
+    __m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+    acc4 = _mm_add_ss(acc4, _mm_shuffle_ps(acc4, acc4, 1));
+    return _mm_cvtss_f32(acc4);
+}
+#endif
+
+/*!
+ * \fn double ssdFloat(const float *s_req, const float *s_des, unsigned int n)
+ * \brief Single precision SSD of two features values buffers
+ *
+ * Squared differences are accumulated in float within blocks of SSD_BLOCK_SIZE features (AVX-512 or AVX2 lanes when available), blocks sums being added in double to bound the rounding error whatever the mesh size
+ */
+inline double ssdFloat(const float *s_req, const float *s_des, unsigned int n)
+{
+    double ssd = 0.;
+    for(unsigned int iBlock = 0 ; iBlock < n ; iBlock += SSD_BLOCK_SIZE)
+    {
+        unsigned int i = iBlock, iEnd = std::min(n, iBlock+SSD_BLOCK_SIZE);
+        float blockSum = 0.f;
+#if defined(__AVX512F__)
+        __m512 acc = _mm512_setzero_ps();
+        for( ; i+16 <= iEnd ; i+=16)
+        {
+            __m512 d = _mm512_sub_ps(_mm512_loadu_ps(s_req+i), _mm512_loadu_ps(s_des+i));
+            acc = _mm512_fmadd_ps(d, d, acc);
+        }
+        blockSum = _mm512_reduce_add_ps(acc);
+#elif defined(__AVX2__)
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        for( ; i+16 <= iEnd ; i+=16)
+        {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(s_req+i), _mm256_loadu_ps(s_des+i));
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(s_req+i+8), _mm256_loadu_ps(s_des+i+8));
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(d0, d0));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(d1, d1));
+        }
+        blockSum = horizontalSum(_mm256_add_ps(acc0, acc1));
+#else
+        //independent partial sums, to be vectorized by the compiler
+        float acc[8] = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+        for( ; i+8 <= iEnd ; i+=8)
+            for(unsigned int j = 0 ; j < 8 ; j++)
+            {
+                float d = s_req[i+j] - s_des[i+j];
+                acc[j] += d*d;
+            }
+        blockSum = ((acc[0]+acc[1])+(acc[2]+acc[3]))+((acc[4]+acc[5])+(acc[6]+acc[7]));
+#endif
+        for( ; i < iEnd ; i++)
+        {
+            float d = s_req[i] - s_des[i];
+            blockSum += d*d;
+        }
+        ssd += blockSum;
+    }
+    return ssd;
+}
+
+/*!
+ * \fn double residualsFloat(const float *s_des, const float *s_req, unsigned int n, float *e)
+ * \brief Single precision residuals e = s_des - s_req, returning their SSD accumulated as in ssdFloat (float within blocks of SSD_BLOCK_SIZE features, double across blocks)
+ */
+inline double residualsFloat(const float *s_des, const float *s_req, unsigned int n, float *e)
+{
+    double ssd = 0.;
+    for(unsigned int iBlock = 0 ; iBlock < n ; iBlock += SSD_BLOCK_SIZE)
+    {
+        unsigned int i = iBlock, iEnd = std::min(n, iBlock+SSD_BLOCK_SIZE);
+        float blockSum = 0.f;
+#if defined(__AVX512F__)
+        __m512 acc = _mm512_setzero_ps();
+        for( ; i+16 <= iEnd ; i+=16)
+        {
+            __m512 d = _mm512_sub_ps(_mm512_loadu_ps(s_des+i), _mm512_loadu_ps(s_req+i));
+            _mm512_storeu_ps(e+i, d);
+            acc = _mm512_fmadd_ps(d, d, acc);
+        }
+        blockSum = _mm512_reduce_add_ps(acc);
+#elif defined(__AVX2__)
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        for( ; i+16 <= iEnd ; i+=16)
+        {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(s_des+i), _mm256_loadu_ps(s_req+i));
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(s_des+i+8), _mm256_loadu_ps(s_req+i+8));
+            _mm256_storeu_ps(e+i, d0);
+            _mm256_storeu_ps(e+i+8, d1);
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(d0, d0));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(d1, d1));
+        }
+        blockSum = horizontalSum(_mm256_add_ps(acc0, acc1));
+#else
+        //4 independent partial sums, faster than the double precision loop even when the compiler does not vectorize
+        float acc0 = 0.f, acc1 = 0.f, acc2 = 0.f, acc3 = 0.f;
+        for( ; i+4 <= iEnd ; i+=4)
+        {
+            float d0 = s_des[i] - s_req[i], d1 = s_des[i+1] - s_req[i+1], d2 = s_des[i+2] - s_req[i+2], d3 = s_des[i+3] - s_req[i+3];
+            e[i] = d0; e[i+1] = d1; e[i+2] = d2; e[i+3] = d3;
+            acc0 += d0*d0; acc1 += d1*d1; acc2 += d2*d2; acc3 += d3*d3;
+        }
+        blockSum = (acc0+acc1)+(acc2+acc3);
+#endif
+        for( ; i < iEnd ; i++)
+        {
+            e[i] = s_des[i] - s_req[i];
+            blockSum += e[i]*e[i];
+        }
+        ssd += blockSum;
+    }
+    return ssd;
+}
+
+/*!
+ * \fn double dotFloat(const float *a, const float *b, unsigned int n)
+ * \brief Single precision dot product, accumulated as in ssdFloat (float within blocks of SSD_BLOCK_SIZE features, double across blocks)
+ */
+inline double dotFloat(const float *a, const float *b, unsigned int n)
+{
+    double dot = 0.;
+    for(unsigned int iBlock = 0 ; iBlock < n ; iBlock += SSD_BLOCK_SIZE)
+    {
+        unsigned int i = iBlock, iEnd = std::min(n, iBlock+SSD_BLOCK_SIZE);
+        float blockSum = 0.f;
+#if defined(__AVX512F__)
+        __m512 acc = _mm512_setzero_ps();
+        for( ; i+16 <= iEnd ; i+=16)
+            acc = _mm512_fmadd_ps(_mm512_loadu_ps(a+i), _mm512_loadu_ps(b+i), acc);
+        blockSum = _mm512_reduce_add_ps(acc);
+#elif defined(__AVX2__)
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        for( ; i+16 <= iEnd ; i+=16)
+        {
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a+i), _mm256_loadu_ps(b+i)));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a+i+8), _mm256_loadu_ps(b+i+8)));
+        }
+        blockSum = horizontalSum(_mm256_add_ps(acc0, acc1));
+#else
+        float acc0 = 0.f, acc1 = 0.f, acc2 = 0.f, acc3 = 0.f;
+        for( ; i+4 <= iEnd ; i+=4)
+        {
+            acc0 += a[i]*b[i]; acc1 += a[i+1]*b[i+1]; acc2 += a[i+2]*b[i+2]; acc3 += a[i+3]*b[i+3];
+        }
+        blockSum = (acc0+acc1)+(acc2+acc3);
+#endif
+        for( ; i < iEnd ; i++)
+            blockSum += a[i]*b[i];
+        dot += blockSum;
+    }
+    return dot;
+}
+
+/*!
+ * \fn float robustScale(const float *e, unsigned int n, std::vector<float> &buf)
+ * \brief Scale of the residuals e from their median absolute deviation, medians being selected (std::nth_element, linear time) rather than sorted, over ROBUST_SCALE_SAMPLES regularly subsampled residuals at most
+ */
+inline float robustScale(const float *e, unsigned int n, std::vector<float> &buf)
+{
+    if(n == 0)
+        return 1.f;
+    unsigned int step = (n + ROBUST_SCALE_SAMPLES - 1)/ROBUST_SCALE_SAMPLES;
+    buf.resize((n + step - 1)/step);
+    for(unsigned int i = 0, j = 0 ; i < n ; i += step, j++)
+        buf[j] = e[i];
+    std::vector<float>::iterator mid = buf.begin() + buf.size()/2;
+    std::nth_element(buf.begin(), mid, buf.end());
+    float median = *mid;
+    for(unsigned int i = 0 ; i < buf.size() ; i++)
+        buf[i] = fabs(buf[i] - median);
+    std::nth_element(buf.begin(), mid, buf.end());
+    float scale = MAD_TO_SIGMA*(*mid);
+    //more than half of the residuals are equal: any other residual is an outlier
+    return (scale > std::numeric_limits<float>::min()) ? scale : std::numeric_limits<float>::min();
+}
+
+/*!
+ * \fn double tukeyWeights(const float *e, unsigned int n, float scale, float *w)
+ * \brief Tukey biweights w = (1-u^2)^2 of the residuals e, with u = e/(TUKEY_C scale) and w = 0 for |u| >= 1, computed without branches (AVX-512 or AVX2 lanes when available)
+ * \return the robust cost sum of rho(e) = (TUKEY_C scale)^2/6 (1-(1-u^2)^3), saturating for |u| >= 1
+ */
+inline double tukeyWeights(const float *e, unsigned int n, float scale, float *w)
+{
+    float invCs = 1.f/(TUKEY_C*scale);
+    double cost = 0.;
+    unsigned int i = 0;
+#if defined(__AVX512F__)
+    __m512 inv = _mm512_set1_ps(invCs), one = _mm512_set1_ps(1.f), zero = _mm512_setzero_ps(), acc = _mm512_setzero_ps();
+    for( ; i+16 <= n ; i+=16)
+    {
+        __m512 u = _mm512_mul_ps(_mm512_loadu_ps(e+i), inv);
+        __m512 t = _mm512_max_ps(_mm512_fnmadd_ps(u, u, one), zero);
+        __m512 t2 = _mm512_mul_ps(t, t);
+        _mm512_storeu_ps(w+i, t2);
+        acc = _mm512_add_ps(acc, _mm512_fnmadd_ps(t2, t, one));
+    }
+    cost = _mm512_reduce_add_ps(acc);
+#elif defined(__AVX2__)
+    __m256 inv = _mm256_set1_ps(invCs), one = _mm256_set1_ps(1.f), zero = _mm256_setzero_ps(), acc = _mm256_setzero_ps();
+    for( ; i+8 <= n ; i+=8)
+    {
+        __m256 u = _mm256_mul_ps(_mm256_loadu_ps(e+i), inv);
+        __m256 t = _mm256_max_ps(_mm256_sub_ps(one, _mm256_mul_ps(u, u)), zero);
+        __m256 t2 = _mm256_mul_ps(t, t);
+        _mm256_storeu_ps(w+i, t2);
+        acc = _mm256_add_ps(acc, _mm256_sub_ps(one, _mm256_mul_ps(t2, t)));
+    }
+    cost = horizontalSum(acc);
+#endif
+    //to be vectorized by the compiler
+    float acc1 = 0.f;
+    for( ; i < n ; i++)
+    {
+        float u = e[i]*invCs;
+        float t = std::max(1.f - u*u, 0.f);
+        w[i] = t*t;
+        acc1 += 1.f - t*t*t;
+    }
+    cost += acc1;
+    return cost*(TUKEY_C*scale)*(TUKEY_C*scale)/6.;
+}
+
+#endif //MPPSSDkernels_h
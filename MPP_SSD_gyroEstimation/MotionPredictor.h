@@ -0,0 +1,135 @@
+/*!
+ \file MotionPredictor.h
+ \brief Motion models (predictor) extrapolating the initial orientation of the next image from the previous estimated ones and the acquisition times of the images
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef MotionPredictor_h
+#define MotionPredictor_h
+
+#include <visp/vpHomogeneousMatrix.h>
+#include <visp/vpPoseVector.h>
+
+#include <cmath>
+#include <vector>
+
+#include "FrameScheduler.h"
+
+//smoothing factor of the angular velocity of the exponentially smoothed motion model (weight of the last velocity)
+#define PREDICTOR_SMOOTHING 0.5
+
+/*!
+ * \fn double frameTime(unsigned int imNum, const std::vector<double> &v_frameTimes)
+ * \brief Acquisition time (s) of the image imNum: its time in the acquisition times file if any, imNum FRAME_PERIOD otherwise
+ */
+inline double frameTime(unsigned int imNum, const std::vector<double> &v_frameTimes)
+{
+    if((imNum < v_frameTimes.size()) && !std::isnan(v_frameTimes[imNum]))
+        return v_frameTimes[imNum];
+    return imNum*FRAME_PERIOD*1e-3;
+}
+
+/*!
+ * \class MotionPredictor
+ * \brief Extrapolation of the orientation of the next image from the orientations estimated for the previous ones (cumulative poses, with respect to the reference image) and their acquisition times
+ *
+ * Motion models: 0 none, 1 constant angular velocity, 2 constant angular acceleration, 3 exponentially smoothed angular velocity (PREDICTOR_SMOOTHING).
+ * Velocities are the rotations between successive images (left increments, as r_to_save = dMd_prec*key_dMc) divided by their time intervals, so that the prediction follows the actual time to the next image (dropped images, adaptive step).
+ */
+class MotionPredictor
+{
+public:
+    MotionPredictor(unsigned int type) : type(type), nbPoses(0)
+    {
+        T[0] = T[1] = T[2] = 0.;
+        omega[0] = omega[1] = omega[2] = 0.;
+    }
+
+    /*!
+     * \fn void add(const vpPoseVector &r, double t)
+     * \brief Appends the cumulative pose estimated for the last image, acquired at time t (s)
+     */
+    void add(const vpPoseVector &r, double t)
+    {
+        M[2] = M[1];
+        M[1] = M[0];
+        M[0].buildFrom(r);
+        T[2] = T[1];
+        T[1] = T[0];
+        T[0] = t;
+        if(nbPoses < 3)
+            nbPoses++;
+
+        double w[3];
+        if((type == 3) && (nbPoses >= 2) && velocity(0, w))
+            for(unsigned int i = 0 ; i < 3 ; i++)
+                omega[i] = (nbPoses == 2) ? w[i] : PREDICTOR_SMOOTHING*w[i] + (1.-PREDICTOR_SMOOTHING)*omega[i];
+    }
+
+    /*!
+     * \fn bool predict(vpHomogeneousMatrix &M_pred, double t)
+     * \brief Cumulative pose of the next image, acquired at time t (s), false if the motion model is off or the history is too short (then M_pred is unchanged)
+     */
+    bool predict(vpHomogeneousMatrix &M_pred, double t)
+    {
+        double w0[3], w1[3], dt = t - T[0];
+        switch(type)
+        {
+            case 1:
+            {
+                if((nbPoses < 2) || !velocity(0, w0))
+                    return false;
+                break;
+            }
+            case 2:
+            {
+                if((nbPoses < 3) || !velocity(0, w0) || !velocity(1, w1))
+                    return false;
+                //velocities at the middle of their intervals, the mean velocity from T[0] to t being the one at (T[0]+t)/2
+                double a = (t - T[1])/(T[0] - T[2]);
+                for(unsigned int i = 0 ; i < 3 ; i++)
+                    w0[i] += a*(w0[i] - w1[i]);
+                break;
+            }
+            case 3:
+            {
+                if(nbPoses < 2)
+                    return false;
+                for(unsigned int i = 0 ; i < 3 ; i++)
+                    w0[i] = omega[i];
+                break;
+            }
+            default:
+                return false;
+        }
+        M_pred = vpHomogeneousMatrix(vpPoseVector(0.0, 0.0, 0.0, w0[0]*dt, w0[1]*dt, w0[2]*dt))*M[0];
+        return true;
+    }
+
+private:
+    /*!
+     * \fn bool velocity(unsigned int k, double *w)
+     * \brief Angular velocity (theta u per s) from the pose k+1 to the pose k, false if their times are not increasing
+     */
+    bool velocity(unsigned int k, double *w)
+    {
+        double dt = T[k] - T[k+1];
+        if(!(dt > 0.))
+            return false;
+        M[k+1].inverse(Mi);
+        v.buildFrom(M[k]*Mi);
+        for(unsigned int i = 0 ; i < 3 ; i++)
+            w[i] = v[3+i]/dt;
+        return true;
+    }
+
+    unsigned int type, nbPoses;
+    vpHomogeneousMatrix M[3], Mi;
+    double T[3], omega[3];
+    vpPoseVector v;
+};
+
+#endif //MotionPredictor_h
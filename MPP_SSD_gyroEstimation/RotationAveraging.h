@@ -0,0 +1,253 @@
+/*!
+ \file RotationAveraging.h
+ \brief Rotation helpers (row major 3x3 matrices, exponential and logarithm maps, chordal mean) and robust averaging of the relative rotations between key images
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef RotationAveraging_h
+#define RotationAveraging_h
+
+#include <visp/vpHomogeneousMatrix.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//rotation averaging over the key images: number of earlier key images (of close orientation) each key image is registered to, Cauchy scale (rad) of the residuals, maximum number of reweighted Gauss-Newton iterations and convergence threshold of the squared rotation increments
+#define RA_NB_NEIGHBOURS 4
+#define RA_CAUCHY 0.05
+#define RA_ITERATIONS 30
+#define RA_CONVERGENCE 1e-12
+
+/*!
+ * \struct RotationEdge
+ * \brief Relative rotation measurement between the key images i and j of the rotations graph: R_j ~ R R_i (row major), R_i and R_j being their cumulative rotations
+ */
+struct RotationEdge
+{
+    unsigned int i, j;
+    double R[9];
+};
+
+/*!
+ * \fn void rotationMatrix(const vpHomogeneousMatrix &M, double *R)
+ * \brief Row major rotation of M
+ */
+inline void rotationMatrix(const vpHomogeneousMatrix &M, double *R)
+{
+    for(unsigned int k = 0 ; k < 3 ; k++)
+        for(unsigned int m = 0 ; m < 3 ; m++)
+            R[3*k+m] = M[k][m];
+}
+
+/*!
+ * \fn void mult3x3(const double *A, const double *B, double *C, bool At = false)
+ * \brief C = A B (or A^T B if At), row major 3x3 matrices, C being distinct from A and B
+ */
+inline void mult3x3(const double *A, const double *B, double *C, bool At = false)
+{
+    for(unsigned int k = 0 ; k < 3 ; k++)
+        for(unsigned int m = 0 ; m < 3 ; m++)
+        {
+            C[3*k+m] = 0.;
+            for(unsigned int n = 0 ; n < 3 ; n++)
+                C[3*k+m] += (At ? A[3*n+k] : A[3*k+n])*B[3*n+m];
+        }
+}
+
+/*!
+ * \fn void rotationExp(const double *w, double *R)
+ * \brief Rotation R = exp([w]x) of the rotation vector w (Rodrigues' formula), row major
+ */
+inline void rotationExp(const double *w, double *R)
+{
+    double theta = sqrt(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]);
+    double a = (theta < 1e-8) ? 1. : sin(theta)/theta, b = (theta < 1e-8) ? 0.5 : (1.-cos(theta))/(theta*theta);
+    R[0] = 1. - b*(w[1]*w[1] + w[2]*w[2]); R[1] = -a*w[2] + b*w[0]*w[1]; R[2] = a*w[1] + b*w[0]*w[2];
+    R[3] = a*w[2] + b*w[0]*w[1]; R[4] = 1. - b*(w[0]*w[0] + w[2]*w[2]); R[5] = -a*w[0] + b*w[1]*w[2];
+    R[6] = -a*w[1] + b*w[0]*w[2]; R[7] = a*w[0] + b*w[1]*w[2]; R[8] = 1. - b*(w[0]*w[0] + w[1]*w[1]);
+}
+
+/*!
+ * \fn void rotationLog(const double *R, double *w)
+ * \brief Rotation vector w of the rotation R (row major), of norm in [0, pi]
+ */
+inline void rotationLog(const double *R, double *w)
+{
+    double c = std::max(-1., std::min(1., 0.5*(R[0] + R[4] + R[8] - 1.)));
+    double theta = acos(c);
+    if(theta < M_PI - 1e-4)
+    {
+        double a = (theta < 1e-8) ? 0.5 : 0.5*theta/sin(theta);
+        w[0] = a*(R[7] - R[5]);
+        w[1] = a*(R[2] - R[6]);
+        w[2] = a*(R[3] - R[1]);
+        return;
+    }
+    //near pi: axis from the largest diagonal term of (R + I)/2 = u u^T
+    unsigned int k = 0;
+    if(R[4] > R[3*k+k]) k = 1;
+    if(R[8] > R[3*k+k]) k = 2;
+    double u[3];
+    for(unsigned int m = 0 ; m < 3 ; m++)
+        u[m] = 0.5*(R[3*m+k] + R[3*k+m]) + ((m == k) ? 1. : 0.);
+    double n = sqrt(u[0]*u[0] + u[1]*u[1] + u[2]*u[2]);
+    for(unsigned int m = 0 ; m < 3 ; m++)
+        w[m] = theta*u[m]/n;
+}
+
+/*!
+ * \fn void meanRotation(const std::vector<double> &v_R, double *R)
+ * \brief Karcher mean R of the rotations v_R (9 per rotation, row major), from the first one
+ */
+inline void meanRotation(const std::vector<double> &v_R, double *R)
+{
+    unsigned int n = v_R.size()/9;
+    double w[3], dw[3], dR[9], Ri[9], E[9];
+    for(unsigned int k = 0 ; k < 9 ; k++)
+        R[k] = v_R[k];
+    for(unsigned int it = 0 ; it < 10 ; it++)
+    {
+        dw[0] = dw[1] = dw[2] = 0.;
+        for(unsigned int i = 0 ; i < n ; i++)
+        {
+            //log(R_i R^T)
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                for(unsigned int m = 0 ; m < 3 ; m++)
+                    E[3*k+m] = v_R[9*i+3*k]*R[3*m] + v_R[9*i+3*k+1]*R[3*m+1] + v_R[9*i+3*k+2]*R[3*m+2];
+            rotationLog(E, w);
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                dw[k] += w[k]/n;
+        }
+        rotationExp(dw, dR);
+        mult3x3(dR, R, Ri);
+        for(unsigned int k = 0 ; k < 9 ; k++)
+            R[k] = Ri[k];
+        if(dw[0]*dw[0] + dw[1]*dw[1] + dw[2]*dw[2] < 1e-20)
+            break;
+    }
+}
+
+/*!
+ * \fn unsigned int averageRotations(const std::vector<RotationEdge> &edges, std::vector<double> &R, std::vector<double> &w)
+ * \brief Robust rotation averaging: minimizes sum_e rho(|log(R_j (R_e R_i)^T)|) over the rotations R (9 per node, row major, initial values as input), the first one being fixed, rho being the Cauchy loss of scale RA_CAUCHY
+ *
+ * Iteratively reweighted Gauss-Newton on the left increments R <- exp(d) R: the residual of an edge being linearized as r + d_j - R_j R_i^T d_i, the normal equations (diagonal blocks sum(w) I)
+ * are solved by matrix-free conjugate gradients, Jacobi preconditioned, so that a sweep costs a few passes over the edges whatever the number of nodes.
+ * \param w receives the final weight of every edge (close to 0 for outliers)
+ * \return the number of Gauss-Newton iterations
+ */
+inline unsigned int averageRotations(const std::vector<RotationEdge> &edges, std::vector<double> &R, std::vector<double> &w)
+{
+    unsigned int nbNodes = R.size()/9, nbEdges = edges.size(), n3 = 3*nbNodes;
+    std::vector<double> A(9*nbEdges), res(3*nbEdges), diag(nbNodes), g(n3), x(n3), rc(n3), z(n3), p(n3), Hp(n3);
+    w.assign(nbEdges, 1.);
+    double P[9], E[9], dR[9], Rn[9];
+    
+    //H v for the current weights and linearizations, the first node being fixed
+    auto product = [&](const std::vector<double> &v, std::vector<double> &Hv)
+    {
+        std::fill(Hv.begin(), Hv.end(), 0.);
+        for(unsigned int e = 0 ; e < nbEdges ; e++)
+        {
+            unsigned int i = edges[e].i, j = edges[e].j;
+            const double *Ae = &A[9*e];
+            double t[3];
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                t[k] = w[e]*(v[3*j+k] - Ae[3*k]*v[3*i] - Ae[3*k+1]*v[3*i+1] - Ae[3*k+2]*v[3*i+2]);
+            for(unsigned int k = 0 ; k < 3 ; k++)
+            {
+                Hv[3*j+k] += t[k];
+                Hv[3*i+k] -= Ae[k]*t[0] + Ae[3+k]*t[1] + Ae[6+k]*t[2];
+            }
+        }
+        Hv[0] = Hv[1] = Hv[2] = 0.;
+    };
+    
+    unsigned int it;
+    for(it = 0 ; it < RA_ITERATIONS ; it++)
+    {
+        //residuals, weights and linearizations at the current rotations
+        std::fill(diag.begin(), diag.end(), 0.);
+        std::fill(g.begin(), g.end(), 0.);
+        for(unsigned int e = 0 ; e < nbEdges ; e++)
+        {
+            unsigned int i = edges[e].i, j = edges[e].j;
+            mult3x3(edges[e].R, &R[9*i], P);
+            //E = R_j P^T, A = R_j R_i^T
+            for(unsigned int k = 0 ; k < 3 ; k++)
+                for(unsigned int m = 0 ; m < 3 ; m++)
+                {
+                    E[3*k+m] = R[9*j+3*k]*P[3*m] + R[9*j+3*k+1]*P[3*m+1] + R[9*j+3*k+2]*P[3*m+2];
+                    A[9*e+3*k+m] = R[9*j+3*k]*R[9*i+3*m] + R[9*j+3*k+1]*R[9*i+3*m+1] + R[9*j+3*k+2]*R[9*i+3*m+2];
+                }
+            double *r = &res[3*e];
+            rotationLog(E, r);
+            w[e] = 1./(1. + (r[0]*r[0] + r[1]*r[1] + r[2]*r[2])/(RA_CAUCHY*RA_CAUCHY));
+            diag[i] += w[e];
+            diag[j] += w[e];
+            const double *Ae = &A[9*e];
+            for(unsigned int k = 0 ; k < 3 ; k++)
+            {
+                g[3*j+k] -= w[e]*r[k];
+                g[3*i+k] += w[e]*(Ae[k]*r[0] + Ae[3+k]*r[1] + Ae[6+k]*r[2]);
+            }
+        }
+        g[0] = g[1] = g[2] = 0.;
+        
+        //preconditioned conjugate gradients from x = 0
+        std::fill(x.begin(), x.end(), 0.);
+        rc = g;
+        double rz = 0., gNorm = 0.;
+        for(unsigned int k = 3 ; k < n3 ; k++)
+        {
+            z[k] = (diag[k/3] > 0.) ? rc[k]/diag[k/3] : 0.;
+            rz += rc[k]*z[k];
+            gNorm += g[k]*g[k];
+        }
+        z[0] = z[1] = z[2] = 0.;
+        p = z;
+        for(unsigned int cg = 0 ; (cg < n3) && (rz > 1e-20*gNorm) && (rz > 0.) ; cg++)
+        {
+            product(p, Hp);
+            double pHp = 0.;
+            for(unsigned int k = 0 ; k < n3 ; k++)
+                pHp += p[k]*Hp[k];
+            if(pHp <= 0.)
+                break;
+            double alpha = rz/pHp, rzNew = 0.;
+            for(unsigned int k = 3 ; k < n3 ; k++)
+            {
+                x[k] += alpha*p[k];
+                rc[k] -= alpha*Hp[k];
+                z[k] = (diag[k/3] > 0.) ? rc[k]/diag[k/3] : 0.;
+                rzNew += rc[k]*z[k];
+            }
+            for(unsigned int k = 3 ; k < n3 ; k++)
+                p[k] = z[k] + (rzNew/rz)*p[k];
+            rz = rzNew;
+        }
+        
+        //R <- exp(x) R
+        double change = 0.;
+        for(unsigned int n = 1 ; n < nbNodes ; n++)
+        {
+            rotationExp(&x[3*n], dR);
+            mult3x3(dR, &R[9*n], Rn);
+            for(unsigned int k = 0 ; k < 9 ; k++)
+                R[9*n+k] = Rn[k];
+            change = std::max(change, x[3*n]*x[3*n] + x[3*n+1]*x[3*n+1] + x[3*n+2]*x[3*n+2]);
+        }
+        if(change < RA_CONVERGENCE)
+        {
+            it++;
+            break;
+        }
+    }
+    return it;
+}
+
+#endif //RotationAveraging_h
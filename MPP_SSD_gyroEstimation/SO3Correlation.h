@@ -0,0 +1,340 @@
+/*!
+ \file SO3Correlation.h
+ \brief Full SO(3) cross-correlation of two equirectangular images from their spherical harmonics, whose maxima are the initial orientation guesses of initType 2, and band energies signatures of the key images
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef SO3Correlation_h
+#define SO3Correlation_h
+
+#include <visp/vpImage.h>
+#include <visp/vpPoseVector.h>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+//SO(3) correlation initial guesses: spherical harmonics bandwidth (power of 2) and number of correlation maxima
+#define SO3_FFT_BANDWIDTH 16
+#define SO3_FFT_NB_PEAKS 4
+//SO(3) correlation initial guesses: number of correlation values ranked at a time per maximum searched (the next ones being ranked only if the isolated maxima are not all found among them)
+#define SO3_FFT_CANDIDATES 64
+
+/*!
+ * \class SO3Correlation
+ * \brief Full SO(3) cross-correlation of two spherical images sampled on equirectangular grids, from their spherical harmonics up to a bandwidth B
+ *
+ * The spherical harmonics are expressed in a frame whose polar axis is the y (vertical) axis of the equirectangular camera, so that grid rows are iso-colatitudes and grid columns iso-longitudes. The correlation C(alpha, beta, gamma) = sum_{m',m} e^{i(m'alpha + m gamma)} sum_l f_{lm'} conj(g_{lm}) d^l_{m'm}(beta) is computed by 2D FFTs over (alpha, gamma) for 2B samples of beta (Kostelec and Rockmore's separation of variables)
+ */
+class SO3Correlation
+{
+public:
+    /*!
+     * \fn SO3Correlation(unsigned int B)
+     * \brief Precomputes the Wigner d functions of the 2B beta samples, B being a power of 2
+     */
+    SO3Correlation(unsigned int B)
+    : B(B), N(2*B), height(4*B), width(8*B)
+    {
+        //log-factorials for the Wigner d and spherical harmonics normalization
+        std::vector<double> lf(2*B+1, 0.);
+        for(unsigned int k = 1 ; k <= 2*B ; k++)
+            lf[k] = lf[k-1] + log((double)k);
+
+        d.resize(N);
+        for(unsigned int ib = 0 ; ib < N ; ib++)
+        {
+            double beta = M_PI*(2.*ib+1.)/(2.*N);
+            double c = cos(beta*0.5), s = sin(beta*0.5);
+            d[ib].assign(B*N*N, 0.);
+            for(int l = 0 ; l < (int)B ; l++)
+                for(int mp = -l ; mp <= l ; mp++)
+                    for(int m = -l ; m <= l ; m++)
+                    {
+                        double sum = 0.;
+                        for(int k = std::max(0, m-mp) ; k <= std::min(l+m, l-mp) ; k++)
+                        {
+                            double logNum = 0.5*(lf[l+mp]+lf[l-mp]+lf[l+m]+lf[l-m]) - (lf[l+m-k]+lf[k]+lf[mp-m+k]+lf[l-mp-k]);
+                            int pc = 2*l+m-mp-2*k, ps = mp-m+2*k;
+                            sum += (((mp-m+k)%2) ? -1. : 1.) * exp(logNum) * pow(c, pc) * pow(s, ps);
+                        }
+                        d[ib][index(l, mp, m)] = sum;
+                    }
+        }
+
+        //longitude harmonics e^{-i m phi} of the grid columns, and twiddle factors e^{2 i pi k/N} of the FFTs
+        Em.resize(width*B);
+        for(unsigned int u = 0 ; u < width ; u++)
+        {
+            double phi = 2.*M_PI*(u+0.5)/width - M_PI;
+            for(unsigned int m = 0 ; m < B ; m++)
+                Em[u*B + m] = std::complex<double>(cos(m*phi), -sin(m*phi));
+        }
+        twiddles.resize(N/2);
+        for(unsigned int k = 0 ; k < N/2 ; k++)
+            twiddles[k] = std::complex<double>(cos(2.*M_PI*k/N), sin(2.*M_PI*k/N));
+
+        //normalized associated Legendre functions of the grid rows, weighted by the quadrature
+        Plm.assign(height*B*B, 0.);
+        for(unsigned int v = 0 ; v < height ; v++)
+        {
+            double theta = M_PI*(1.-(v+0.5)/height); //colatitude from the y axis, pointing downward
+            double x = cos(theta), sx = sin(theta), w = sx*(M_PI/height)*(2.*M_PI/width);
+            for(int m = 0 ; m < (int)B ; m++)
+            {
+                //P_m^m, P_{m+1}^m then upward recurrence on l (Condon-Shortley phase)
+                double pmm = 1.;
+                for(int k = 1 ; k <= m ; k++)
+                    pmm *= -(2.*k-1.)*sx;
+                double plm2 = 0., plm1 = pmm;
+                for(int l = m ; l < (int)B ; l++)
+                {
+                    double plm;
+                    if(l == m)
+                        plm = pmm;
+                    else if(l == m+1)
+                        plm = x*(2.*m+1.)*pmm;
+                    else
+                        plm = ((2.*l-1.)*x*plm1 - (l+m-1.)*plm2)/(l-m);
+                    if(l > m)
+                    {
+                        plm2 = plm1;
+                        plm1 = plm;
+                    }
+                    double Nlm = sqrt((2.*l+1.)/(4.*M_PI) * exp(lf[l-m]-lf[l+m]));
+                    Plm[(v*B + l)*B + m] = Nlm*plm*w;
+                }
+            }
+        }
+    }
+
+    /*!
+     * \fn unsigned int getHeight() const
+     * \brief Height of the equirectangular images to provide to spectrum (their width being twice)
+     */
+    unsigned int getHeight() const
+    {
+        return height;
+    }
+
+    /*!
+     * \fn void spectrum(const vpImage<unsigned char> &I, std::vector<std::complex<double> > &flm)
+     * \brief Spherical harmonics coefficients f_{lm}, l < B, of an equirectangular image of getHeight() x 2 getHeight() pixels (row v at latitude (v+0.5-H/2) pi/H, column u at longitude (u+0.5-W/2) 2 pi/W)
+     */
+    void spectrum(const vpImage<unsigned char> &I, std::vector<std::complex<double> > &flm)
+    {
+        flm.assign(B*B, std::complex<double>(0., 0.));
+        Fm.resize(B);
+        for(unsigned int v = 0 ; v < height ; v++)
+        {
+            //Fourier coefficients of the row along the longitude
+            std::fill(Fm.begin(), Fm.end(), std::complex<double>(0., 0.));
+            for(unsigned int u = 0 ; u < width ; u++)
+            {
+                double Ivu = I[v][u];
+                const std::complex<double> *Eu = &Em[u*B];
+                for(unsigned int m = 0 ; m < B ; m++)
+                    Fm[m] += Ivu*Eu[m];
+            }
+            for(unsigned int l = 0 ; l < B ; l++)
+                for(unsigned int m = 0 ; m <= l ; m++)
+                    flm[l*l+l+m] += Plm[(v*B + l)*B + m]*Fm[m];
+        }
+        //real image: f_{l,-m} = (-1)^m conj(f_{lm})
+        for(unsigned int l = 0 ; l < B ; l++)
+            for(unsigned int m = 1 ; m <= l ; m++)
+                flm[l*l+l-m] = ((m%2) ? -1. : 1.)*std::conj(flm[l*l+l+m]);
+    }
+
+    /*!
+     * \fn void bandEnergies(const std::vector<std::complex<double> > &flm, std::vector<float> &signature) const
+     * \brief Rotation invariant signature of a spectrum: square roots of the energies sum_m |f_{lm}|^2 of the bands 0 < l < B, normalized to unit norm (the mean intensity, l = 0, and the contrast being ignored)
+     */
+    void bandEnergies(const std::vector<std::complex<double> > &flm, std::vector<float> &signature) const
+    {
+        signature.assign(B-1, 0.f);
+        double norm = 0.;
+        for(unsigned int l = 1 ; l < B ; l++)
+        {
+            double E = 0.;
+            for(unsigned int i = l*l ; i < (l+1)*(l+1) ; i++)
+                E += std::norm(flm[i]);
+            signature[l-1] = sqrt(E);
+            norm += E;
+        }
+        if(norm > 0.)
+            for(unsigned int l = 0 ; l < signature.size() ; l++)
+                signature[l] /= sqrt(norm);
+    }
+
+    /*!
+     * \fn void peaks(const std::vector<std::complex<double> > &flm, const std::vector<std::complex<double> > &glm, unsigned int nbPeaks, std::vector<vpPoseVector> &v_r)
+     * \brief Rotations of the nbPeaks highest maxima of the correlation of f with g, as rotations R of the camera frame such that f(X) ~ g(R^T X)
+     *
+     * Maxima closer than the angular step of the grid to a higher one are skipped. Only the highest correlation values are ranked (std::partial_sort, SO3_FFT_CANDIDATES nbPeaks at a time),
+     * the correlation and ranking buffers being reused from one call to another.
+     */
+    void peaks(const std::vector<std::complex<double> > &flm, const std::vector<std::complex<double> > &glm, unsigned int nbPeaks, std::vector<vpPoseVector> &v_r)
+    {
+        C.resize(N*N*N);
+        S.resize(N*N);
+        for(unsigned int ib = 0 ; ib < N ; ib++)
+        {
+            std::fill(S.begin(), S.end(), std::complex<double>(0., 0.));
+            for(int l = 0 ; l < (int)B ; l++)
+                for(int mp = -l ; mp <= l ; mp++)
+                    for(int m = -l ; m <= l ; m++)
+                        S[((mp+N)%N)*N + (m+N)%N] += flm[l*l+l+mp]*std::conj(glm[l*l+l+m])*d[ib][index(l, mp, m)];
+            fft2(S, N);
+            for(unsigned int k = 0 ; k < N*N ; k++)
+                C[ib*N*N + k] = S[k].real();
+        }
+
+        //decreasing correlation, the lowest index first in case of equality
+        order.resize(C.size());
+        for(unsigned int k = 0 ; k < order.size() ; k++)
+            order[k] = k;
+        const std::vector<double> &Cr = C;
+        auto higher = [&Cr](unsigned int a, unsigned int b) { return (Cr[a] > Cr[b]) || ((Cr[a] == Cr[b]) && (a < b)); };
+
+        double minDist = 2.*M_PI/N, R[9], tu[3];
+        unsigned int nbRanked = 0, block = std::max(SO3_FFT_CANDIDATES*nbPeaks, 1u);
+        v_R.clear();
+        v_r.clear();
+        for(unsigned int k = 0 ; (k < order.size()) && (v_r.size() < nbPeaks) ; k++)
+        {
+            if(k == nbRanked)
+            {
+                nbRanked = std::min(nbRanked + block, (unsigned int)order.size());
+                std::partial_sort(order.begin()+k, order.begin()+nbRanked, order.end(), higher);
+            }
+            unsigned int ib = order[k]/(N*N), ia = (order[k]/N)%N, ig = order[k]%N;
+            rotationFromEuler(2.*M_PI*ia/N, M_PI*(2.*ib+1.)/(2.*N), 2.*M_PI*ig/N, R);
+            bool isolated = true;
+            for(unsigned int p = 0 ; isolated && (p < v_R.size()/9) ; p++)
+                isolated = (rotationDistance(R, &v_R[9*p]) > minDist);
+            if(!isolated)
+                continue;
+            v_R.insert(v_R.end(), R, R+9);
+            thetaUFromRotation(R, tu);
+            v_r.push_back(vpPoseVector(0.0, 0.0, 0.0, tu[0], tu[1], tu[2]));
+        }
+    }
+
+private:
+    unsigned int index(int l, int mp, int m) const
+    {
+        return (l*N + (mp+N)%N)*N + (m+N)%N;
+    }
+
+    /*!
+     * \fn void fft(std::complex<double> *x, unsigned int n, unsigned int stride) const
+     * \brief In-place radix-2 inverse FFT without normalization, x_k = sum_j x_j e^{2 i pi jk/n}, n dividing N
+     */
+    void fft(std::complex<double> *x, unsigned int n, unsigned int stride) const
+    {
+        for(unsigned int i = 1, j = 0 ; i < n ; i++)
+        {
+            unsigned int bit = n >> 1;
+            for( ; j & bit ; bit >>= 1)
+                j ^= bit;
+            j ^= bit;
+            if(i < j)
+                std::swap(x[i*stride], x[j*stride]);
+        }
+        for(unsigned int len = 2 ; len <= n ; len <<= 1)
+        {
+            unsigned int step = N/len;
+            for(unsigned int i = 0 ; i < n ; i += len)
+                for(unsigned int j = 0 ; j < len/2 ; j++)
+                {
+                    std::complex<double> a = x[(i+j)*stride], b = x[(i+j+len/2)*stride]*twiddles[j*step];
+                    x[(i+j)*stride] = a+b;
+                    x[(i+j+len/2)*stride] = a-b;
+                }
+        }
+    }
+
+    void fft2(std::vector<std::complex<double> > &S, unsigned int n) const
+    {
+        for(unsigned int i = 0 ; i < n ; i++)
+            fft(&S[i*n], n, 1);
+        for(unsigned int j = 0 ; j < n ; j++)
+            fft(&S[j], n, n);
+    }
+
+    /*!
+     * \fn static void rotationFromEuler(double alpha, double beta, double gamma, double *R)
+     * \brief Camera frame rotation matrix (row major) of the ZYZ Euler angles of the spherical harmonics frame, whose x, y, z axes are the camera z, x, y axes
+     */
+    static void rotationFromEuler(double alpha, double beta, double gamma, double *R)
+    {
+        double ca = cos(alpha), sa = sin(alpha), cb = cos(beta), sb = sin(beta), cg = cos(gamma), sg = sin(gamma);
+        double Rs[9] = {ca*cb*cg - sa*sg, -ca*cb*sg - sa*cg, ca*sb,
+                        sa*cb*cg + ca*sg, -sa*cb*sg + ca*cg, sa*sb,
+                        -sb*cg, sb*sg, cb};
+        //camera coordinates (x, y, z) are (y', z', x') of the spherical harmonics frame: R = P^T Rs P
+        const unsigned int p[3] = {1, 2, 0};
+        for(unsigned int i = 0 ; i < 3 ; i++)
+            for(unsigned int j = 0 ; j < 3 ; j++)
+                R[3*i+j] = Rs[3*p[i]+p[j]];
+    }
+
+    static double rotationDistance(const double *Ra, const double *Rb)
+    {
+        double tr = 0.;
+        for(unsigned int k = 0 ; k < 9 ; k++)
+            tr += Ra[k]*Rb[k];
+        return acos(std::max(-1., std::min(1., (tr-1.)*0.5)));
+    }
+
+    static void thetaUFromRotation(const double *R, double *tu)
+    {
+        //unit quaternion (Shepperd), then theta u with theta in [0, pi]
+        double q[4], tr = R[0]+R[4]+R[8];
+        if(tr > 0.)
+        {
+            double s = 2.*sqrt(tr+1.);
+            q[3] = 0.25*s; q[0] = (R[7]-R[5])/s; q[1] = (R[2]-R[6])/s; q[2] = (R[3]-R[1])/s;
+        }
+        else if((R[0] > R[4]) && (R[0] > R[8]))
+        {
+            double s = 2.*sqrt(1.+R[0]-R[4]-R[8]);
+            q[3] = (R[7]-R[5])/s; q[0] = 0.25*s; q[1] = (R[1]+R[3])/s; q[2] = (R[2]+R[6])/s;
+        }
+        else if(R[4] > R[8])
+        {
+            double s = 2.*sqrt(1.+R[4]-R[0]-R[8]);
+            q[3] = (R[2]-R[6])/s; q[0] = (R[1]+R[3])/s; q[1] = 0.25*s; q[2] = (R[5]+R[7])/s;
+        }
+        else
+        {
+            double s = 2.*sqrt(1.+R[8]-R[0]-R[4]);
+            q[3] = (R[3]-R[1])/s; q[0] = (R[2]+R[6])/s; q[1] = (R[5]+R[7])/s; q[2] = 0.25*s;
+        }
+        if(q[3] < 0.)
+            for(unsigned int k = 0 ; k < 4 ; k++)
+                q[k] = -q[k];
+        double sinHalfTheta = sqrt(q[0]*q[0]+q[1]*q[1]+q[2]*q[2]);
+        double scale = (sinHalfTheta > 1e-12) ? 2.*atan2(sinHalfTheta, q[3])/sinHalfTheta : 2.;
+        for(unsigned int k = 0 ; k < 3 ; k++)
+            tu[k] = scale*q[k];
+    }
+
+    unsigned int B, N, height, width;
+    std::vector<std::vector<double> > d;
+    std::vector<double> Plm;
+    std::vector<std::complex<double> > Em, twiddles;
+    //buffer of spectrum: Fourier coefficients of a row
+    std::vector<std::complex<double> > Fm;
+    //buffers of peaks: correlation over the (beta, alpha, gamma) grid, its ranking and the rotations of the maxima found (9 per maximum, row major)
+    std::vector<double> C, v_R;
+    std::vector<std::complex<double> > S;
+    std::vector<unsigned int> order;
+};
+
+#endif //SO3Correlation_h
@@ -0,0 +1,144 @@
+/*!
+ \file ThreadPool.h
+ \brief Fixed set of worker threads running the tasks of parallel loops with the calling thread
+ *
+ \author Guillaume CARON
+ \version 0.1
+ \date october 2026
+ */
+
+#ifndef ThreadPool_h
+#define ThreadPool_h
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * \class ThreadPool
+ * \brief Fixed set of worker threads sharing the tasks of parallel loops with the calling thread
+ */
+class ThreadPool
+{
+public:
+    ThreadPool(unsigned int nbThreads)
+    : task(NULL), runTask(NULL), nbTasks(0), nextTask(0), nbWorking(0), generation(0), stop(false)
+    {
+        for(unsigned int t = 1 ; t < std::max(nbThreads, 1u) ; t++)
+            workers.push_back(std::thread(&ThreadPool::work, this, t));
+    }
+    
+    ~ThreadPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cvWork.notify_all();
+        for(unsigned int t = 0 ; t < workers.size() ; t++)
+            workers[t].join();
+    }
+    
+    /*!
+     * \fn unsigned int size() const
+     * \brief Number of threads running the tasks, the calling one included
+     */
+    unsigned int size() const
+    {
+        return workers.size()+1;
+    }
+    
+    /*!
+     * \fn template<typename Function> void parallelFor(unsigned int n, const Function &f)
+     * \brief Runs f(iTask, iThread) for every iTask of [0, n[ and returns once all of them are done (iThread is 0 for the calling thread)
+     *
+     * Every worker takes part in every call: it reads f and n under the lock, claims tasks until none is left, then leaves the call under the lock.
+     * The call only returns once every worker has left it, so that no worker can still be running f, nor claim a task of the next call with the former f.
+     * f is called through a function pointer instantiated for its type rather than wrapped in a std::function, so that a call does not allocate.
+     */
+    template<typename Function>
+    void parallelFor(unsigned int n, const Function &f)
+    {
+        if(workers.empty() || (n < 2))
+        {
+            for(unsigned int i = 0 ; i < n ; i++)
+                f(i, 0);
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            task = &f;
+            runTask = &ThreadPool::call<Function>;
+            nbTasks = n;
+            nextTask = 0;
+            nbWorking = workers.size();
+            generation++;
+        }
+        cvWork.notify_all();
+        runTasks(&f, &ThreadPool::call<Function>, n, 0);
+        std::unique_lock<std::mutex> lock(mtx);
+        cvDone.wait(lock, [this] { return nbWorking == 0; });
+        task = NULL;
+        runTask = NULL;
+    }
+    
+private:
+    typedef void (*TaskRunner)(const void *, unsigned int, unsigned int);
+    
+    template<typename Function>
+    static void call(const void *f, unsigned int iTask, unsigned int iThread)
+    {
+        (*static_cast<const Function *>(f))(iTask, iThread);
+    }
+    
+    void runTasks(const void *f, TaskRunner run, unsigned int n, unsigned int iThread)
+    {
+        unsigned int i;
+        while((i = nextTask++) < n)
+            run(f, i, iThread);
+    }
+    
+    void work(unsigned int iThread)
+    {
+        unsigned long lastGeneration = 0;
+        const void *f;
+        TaskRunner run;
+        unsigned int n;
+        for(;;)
+        {
+            //the task of the new call, read with its generation
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cvWork.wait(lock, [this, lastGeneration] { return stop || (generation != lastGeneration); });
+                if(stop)
+                    return;
+                lastGeneration = generation;
+                f = task;
+                run = runTask;
+                n = nbTasks;
+            }
+            runTasks(f, run, n, iThread);
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                if(--nbWorking == 0)
+                    cvDone.notify_one();
+            }
+        }
+    }
+    
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cvWork, cvDone;
+    const void *task;
+    TaskRunner runTask;
+    unsigned int nbTasks;
+    std::atomic<unsigned int> nextTask;
+    unsigned int nbWorking; //workers that have not left the current call yet
+    unsigned long generation;
+    bool stop;
+};
+
+#endif //ThreadPool_h
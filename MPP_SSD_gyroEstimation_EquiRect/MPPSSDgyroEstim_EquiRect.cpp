@@ -17,6 +17,9 @@
  \param truncGauss truncated Gaussian domain: 1 yes (+ or - 3 lambda_g at most), 0 no (default)
  \param ficPosesInit the text file of initial poses (one pose line per image to process)
  \param ficPosesInit_i0 the first image index of the sequence within the text file of initial poses (default 0)
+ \param compassMode the yaw compass (compass dofs only, without initial poses file): 0 (the default) off, 1 its yaw is the initial guess of gyro.track, 2 its yaw replaces gyro.track (no spherical image nor features set, the error being 1 minus the normalized correlation maximum)
+ *
+ * ./MPPSSDgyroEstim_EquiRect --checks runs the checks of the yaw compass on synthetic 960x480 images and returns the number of failed checks
  *
  \author Guillaume CARON
  \version 0.2
@@ -25,6 +28,7 @@
 
 #include <iostream>
 #include <iomanip>
+#include <complex>
 
 #include <per/prRegularlySampledCSImage.h>
 
@@ -49,6 +53,241 @@
 
 #define VERBOSE
 
+//yaw compass grid: latitude bands x longitude bins (power of 2) of the circular cross-correlation
+#define COMPASS_HEIGHT 64
+#define COMPASS_WIDTH 512
+//yaw compass replacing gyro.track: key image switching threshold of 1 minus the normalized correlation maximum
+#define COMPASS_KEY_THRESHOLD 0.1
+
+//yaw compass checks (--checks): number of images whose compass is timed, minimum normalized correlation maximum of an image and its rotated copy
+#define CHECKS_TIMING_FRAMES 100
+#define CHECKS_MIN_CORRELATION 0.9
+
+/*!
+ * \class YawCompass
+ * \brief Global yaw (rotation around the vertical y axis) estimation of a level equirectangular camera: a yaw is a circular shift of the image columns,
+ * recovered as the maximum of the circular cross-correlation of the rows, weighted by cos(latitude) (the solid angle of a row) and computed by FFT
+ */
+class YawCompass
+{
+public:
+    /*!
+     * \fn void profile(const vpImage<unsigned char> &I, const vpImage<unsigned char> &Mask, std::vector<std::complex<double> > &P)
+     * \brief Spectra of the COMPASS_HEIGHT latitude bands of I, each one being box averaged over COMPASS_WIDTH longitude bins of the mask valid pixels, then zero mean
+     */
+    void profile(const vpImage<unsigned char> &I, const vpImage<unsigned char> &Mask, std::vector<std::complex<double> > &P)
+    {
+        unsigned int height = I.getHeight(), width = I.getWidth();
+        if(colBin.size() != width)
+        {
+            colBin.resize(width);
+            for(unsigned int j = 0 ; j < width ; j++)
+                colBin[j] = (j*COMPASS_WIDTH)/width;
+        }
+        sum.assign(COMPASS_HEIGHT*COMPASS_WIDTH, 0);
+        count.assign(COMPASS_HEIGHT*COMPASS_WIDTH, 0);
+        for(unsigned int i = 0 ; i < height ; i++)
+        {
+            unsigned int *s = &sum[((i*COMPASS_HEIGHT)/height)*COMPASS_WIDTH], *c = &count[((i*COMPASS_HEIGHT)/height)*COMPASS_WIDTH];
+            const unsigned char *pI = I[i], *pM = Mask[i];
+            for(unsigned int j = 0 ; j < width ; j++)
+                if(pM[j])
+                {
+                    s[colBin[j]] += pI[j];
+                    c[colBin[j]]++;
+                }
+        }
+
+        P.resize(COMPASS_HEIGHT*COMPASS_WIDTH);
+        for(unsigned int v = 0 ; v < COMPASS_HEIGHT ; v++)
+        {
+            std::complex<double> *row = &P[v*COMPASS_WIDTH];
+            double mean = 0.;
+            unsigned int nbValid = 0;
+            for(unsigned int u = 0 ; u < COMPASS_WIDTH ; u++)
+                if(count[v*COMPASS_WIDTH+u])
+                {
+                    row[u] = (double)sum[v*COMPASS_WIDTH+u]/count[v*COMPASS_WIDTH+u];
+                    mean += row[u].real();
+                    nbValid++;
+                }
+            if(nbValid)
+                mean /= nbValid;
+            //masked bins do not contribute to the correlation
+            for(unsigned int u = 0 ; u < COMPASS_WIDTH ; u++)
+                row[u] = count[v*COMPASS_WIDTH+u] ? (row[u].real() - mean) : 0.;
+            fft(row, COMPASS_WIDTH, false);
+        }
+    }
+
+    /*!
+     * \fn double yaw(const std::vector<std::complex<double> > &P_req, const std::vector<std::complex<double> > &P_des, double *corr = NULL)
+     * \brief Shift (in radians, in ]-pi, pi]) of the columns of the desired image with respect to the request one, refined at sub-bin level by a parabola fit around the correlation maximum
+     *
+     * With the longitude atan2(x, z) growing with the columns (prEquirectangular), the desired image being the request one rotated by r (I_des(X) = I_req(R^T X)), the shift is the yaw r[4] itself.
+     * corr, if not NULL, gets the correlation maximum normalized by the weighted energies of both images (1 for identical images up to the shift)
+     */
+    double yaw(const std::vector<std::complex<double> > &P_req, const std::vector<std::complex<double> > &P_des, double *corr = NULL)
+    {
+        C.assign(COMPASS_WIDTH, 0.);
+        double energy_req = 0., energy_des = 0.;
+        for(unsigned int v = 0 ; v < COMPASS_HEIGHT ; v++)
+        {
+            double w = cos(M_PI*((v+0.5)/COMPASS_HEIGHT-0.5));
+            const std::complex<double> *a = &P_req[v*COMPASS_WIDTH], *b = &P_des[v*COMPASS_WIDTH];
+            for(unsigned int k = 0 ; k < COMPASS_WIDTH ; k++)
+            {
+                C[k] += w*std::conj(a[k])*b[k];
+                energy_req += w*std::norm(a[k]);
+                energy_des += w*std::norm(b[k]);
+            }
+        }
+        fft(&C[0], COMPASS_WIDTH, true); //C[n] = sum_u req(u) des(u+n)
+
+        unsigned int n = 0;
+        for(unsigned int k = 1 ; k < COMPASS_WIDTH ; k++)
+            if(C[k].real() > C[n].real())
+                n = k;
+        double cm = C[(n+COMPASS_WIDTH-1)%COMPASS_WIDTH].real(), c0 = C[n].real(), cp = C[(n+1)%COMPASS_WIDTH].real();
+        double shift = n, den = cm - 2.*c0 + cp;
+        if(den < 0.)
+            shift += 0.5*(cm - cp)/den;
+        if(shift > COMPASS_WIDTH*0.5)
+            shift -= COMPASS_WIDTH;
+        if(corr)
+            *corr = (energy_req*energy_des > 0.) ? c0/sqrt(energy_req*energy_des) : 0.;
+
+        return 2.*M_PI*shift/COMPASS_WIDTH;
+    }
+
+private:
+    std::vector<unsigned int> colBin, sum, count;
+    std::vector<std::complex<double> > C;
+
+    /*!
+     * \fn static void fft(std::complex<double> *x, unsigned int n, bool inverse)
+     * \brief In-place radix-2 FFT without normalization, x_k = sum_j x_j e^{-+2 i pi jk/n}
+     */
+    static void fft(std::complex<double> *x, unsigned int n, bool inverse)
+    {
+        for(unsigned int i = 1, j = 0 ; i < n ; i++)
+        {
+            unsigned int bit = n >> 1;
+            for( ; j & bit ; bit >>= 1)
+                j ^= bit;
+            j ^= bit;
+            if(i < j)
+                std::swap(x[i], x[j]);
+        }
+        double sgn = inverse ? 1. : -1.;
+        for(unsigned int len = 2 ; len <= n ; len <<= 1)
+        {
+            std::complex<double> wl(cos(2.*M_PI/len), sgn*sin(2.*M_PI/len));
+            for(unsigned int i = 0 ; i < n ; i += len)
+            {
+                std::complex<double> w(1., 0.);
+                for(unsigned int j = 0 ; j < len/2 ; j++)
+                {
+                    std::complex<double> a = x[i+j], b = x[i+j+len/2]*w;
+                    x[i+j] = a+b;
+                    x[i+j+len/2] = a-b;
+                    w *= wl;
+                }
+            }
+        }
+    }
+};
+
+/*!
+ * \fn void yawEquiRect(const vpImage<unsigned char> &I, double yaw, vpImage<unsigned char> &I_r)
+ * \brief Equirectangular image I rotated by the yaw (I_r(X) = I(R^T X)), that is shifted by yaw along the columns, linearly interpolated
+ */
+void yawEquiRect(const vpImage<unsigned char> &I, double yaw, vpImage<unsigned char> &I_r)
+{
+    unsigned int height = I.getHeight(), width = I.getWidth();
+    I_r.resize(height, width);
+    double shift = yaw*width/(2.*M_PI);
+    double f = shift - floor(shift);
+    unsigned int s = ((int)floor(shift) % (int)width + width) % width;
+    for(unsigned int i = 0 ; i < height ; i++)
+        for(unsigned int j = 0 ; j < width ; j++)
+        {
+            //I_r(j) = I(j - shift), between the columns j - s - 1 and j - s
+            unsigned int j0 = (j + 2*width - s - 1) % width, j1 = (j + width - s) % width;
+            I_r[i][j] = (unsigned char)(f*I[i][j0] + (1.-f)*I[i][j1] + 0.5);
+        }
+}
+
+/*!
+ * \fn void renderTexture(vpImage<unsigned char> &I, unsigned int height, double yaw)
+ * \brief Synthetic equirectangular image (width 2 height) of a smooth texture of the sphere rotated by the yaw about y (I(X) = f(R^T X)), the pixel (u, v) of the direction
+ * X = (sin(theta) sin(phi), cos(theta), sin(theta) cos(phi)), with phi = 2 pi (u+0.5)/width - pi and theta = pi (1-(v+0.5)/height) (the longitude atan2(x, z) growing with u)
+ */
+void renderTexture(vpImage<unsigned char> &I, unsigned int height, double yaw)
+{
+    unsigned int width = 2*height;
+    I.resize(height, width);
+    double c = cos(yaw), s = sin(yaw);
+    for(unsigned int v = 0 ; v < height ; v++)
+        for(unsigned int u = 0 ; u < width ; u++)
+        {
+            double theta = M_PI*(1.-(v+0.5)/height), phi = 2.*M_PI*(u+0.5)/width - M_PI;
+            double X[3] = {sin(theta)*sin(phi), cos(theta), sin(theta)*cos(phi)};
+            //R^T X, R being the rotation of angle yaw about y
+            double x = c*X[0] - s*X[2], z = s*X[0] + c*X[2];
+            double phi0 = atan2(x, z), theta0 = acos(X[1]);
+            I[v][u] = (unsigned char)(128. + 50.*sin(phi0 + 2.*theta0) + 35.*sin(3.*phi0 - theta0) + 20.*cos(7.*phi0 + 3.*theta0));
+        }
+}
+
+/*!
+ * \fn int compassChecks()
+ * \brief Checks of the yaw compass on synthetic 960x480 equirectangular images (first argument --checks): the yaw of a copy of the texture rotated about y is the rotation within half a
+ * longitude bin, with a normalized correlation maximum of CHECKS_MIN_CORRELATION at least, the time of the compass of an image (profile and yaw) being measured
+ * \return the number of failed checks
+ */
+int compassChecks()
+{
+    int nbFailures = 0;
+    const unsigned int height = 480;
+    const double yaws[4] = {0.3, -2., 3., 0.004};
+    vpImage<unsigned char> I_req, I_des, Mask(height, 2*height, 255);
+    renderTexture(I_req, height, 0.);
+    YawCompass yawCompass;
+    std::vector<std::complex<double> > P_req, P_des;
+    yawCompass.profile(I_req, Mask, P_req);
+    for(unsigned int k = 0 ; k < 4 ; k++)
+    {
+        renderTexture(I_des, height, yaws[k]);
+        double yaw = 0., corr = 0., t = vpTime::measureTimeMs();
+        for(unsigned int i = 0 ; i < CHECKS_TIMING_FRAMES ; i++)
+        {
+            yawCompass.profile(I_des, Mask, P_des);
+            yaw = yawCompass.yaw(P_req, P_des, &corr);
+        }
+        t = (vpTime::measureTimeMs() - t)/CHECKS_TIMING_FRAMES;
+        double e = remainder(yaw - yaws[k], 2.*M_PI);
+        bool ok = (fabs(e) < M_PI/COMPASS_WIDTH) && (corr > CHECKS_MIN_CORRELATION);
+        std::cout << "compass check " << (ok ? "passed" : "FAILED") << ": yaw " << yaw*180./M_PI << " deg for " << yaws[k]*180./M_PI << " deg (half bin " << 180./COMPASS_WIDTH << " deg), normalized correlation " << corr << ", " << t << " ms per image" << std::endl;
+        nbFailures += ok ? 0 : 1;
+    }
+    
+    //the request image rotated by the yaw found is the desired one (yawEquiRect, stabilization output of compassMode 2)
+    vpImage<unsigned char> I_r;
+    yawEquiRect(I_req, yaws[0], I_r);
+    renderTexture(I_des, height, yaws[0]);
+    double diff = 0.;
+    for(unsigned int v = 0 ; v < height ; v++)
+        for(unsigned int u = 0 ; u < 2*height ; u++)
+            diff += fabs((double)I_r[v][u] - (double)I_des[v][u]);
+    diff /= 2*height*height;
+    bool ok = (diff < 1.);
+    std::cout << "compass rotation check " << (ok ? "passed" : "FAILED") << ": mean absolute difference " << diff << " between the rotated request image and the desired one" << std::endl;
+    nbFailures += ok ? 0 : 1;
+    
+    return nbFailures;
+}
+
 /*!
  * \fn main()
  * \brief Main function of the MPP SSD based spherical orientation estimation
@@ -67,9 +306,13 @@
  *         -6 no initial file index
  *         -7 no last file index
  *         -8 no image step
+ *          the number of failed checks with --checks
  */
 int main(int argc, char **argv)
 {
+    //checks of the yaw compass on synthetic images only
+    if((argc >= 2) && (std::string(argv[1]) == "--checks"))
+        return compassChecks();
     
     //1. Get the parameters of the command line
 
@@ -339,6 +582,20 @@ int main(int argc, char **argv)
     std::cout << "Initial image file number within pose file: " << ficPosesInit_i0 << std::endl;
 #endif
     
+    unsigned int compassMode = 0;
+    if(argc < 16)
+    {
+#ifdef VERBOSE
+        std::cout << "no compass mode given. Set to 0 (off)." << std::endl;
+#endif
+    }
+    else
+        compassMode = atoi(argv[15]);
+    
+#ifdef VERBOSE
+    std::cout << "Compass mode: " << compassMode << std::endl;
+#endif
+    
 #ifdef VERBOSE
     std::cout << "end parameters list" << std::endl;
 #endif
@@ -367,6 +624,16 @@ int main(int argc, char **argv)
 
     gyro.setdof(dofs[0], dofs[1], dofs[2], dofs[3], dofs[4], dofs[5]);
 
+    //compass only: global yaw estimate by circular cross-correlation of the equirectangular rows (0 off, 1 seeds gyro.track, 2 replaces gyro.track)
+    bool compass = (compassMode != 0) && dofs[4] && !dofs[0] && !dofs[1] && !dofs[2] && !dofs[3] && !dofs[5] && !ficInit;
+    //replacing gyro.track, the compass needs neither the spherical images nor the features sets of the current images
+    bool compassOnly = compass && (compassMode == 2);
+    YawCompass yawCompass;
+    std::vector<std::complex<double> > compass_req, compass_des;
+    double compassCorr = 0.;
+    if(compass)
+        yawCompass.profile(I_req, Mask, compass_req);
+
     //prepare the request spherical image (here, the reference image is always considered as the request in order to compute the rotations that allow to rotate it to the current image)
     prRegularlySampledCSImage<unsigned char> IS_req(subdivLevel); //the regularly sample spherical image to be set from the acquired/loaded dual fisheye image
     IS_req.setInterpType(prInterpType::IMAGEPLANE_BILINEAR);
@@ -411,7 +678,8 @@ int main(int argc, char **argv)
     vpPoseVector r, r_to_save;
     vpHomogeneousMatrix key_dMc, dMd_prec;
     
-    bool poseJacobianCompute = true;
+    //pose Jacobian of the desired features set, for gyro.buildFrom: built with it at every image for odometry, built again with it after tracking for the key images only
+    bool poseJacobianCompute = (estimationType == 1);
     //activate the M-Estimator
     bool robust = false;//true;//
     vpImage<unsigned char> I_des;
@@ -430,6 +698,10 @@ int main(int argc, char **argv)
     //double angle = -177.5*M_PI/180.;
     prFeaturesSet<prCartesian3DPointVec, prPhotometricGMS<prCartesian3DPointVec>, prRegularlySampledCSImage > fSet_des;
     double seuilErr = 0.0325; //0.015; //0.0077;// // OK pour 0,325 seul et subdiv3
+    //the error of the compass alone is 1 minus its normalized correlation maximum, not an MPP-SSD
+    double keyThreshold = compassOnly ? COMPASS_KEY_THRESHOLD : seuilErr;
+    prRegularlySampledCSImage<unsigned char> IS_des(subdivLevel);
+    IS_des.setInterpType(prInterpType::IMAGEPLANE_BILINEAR);
     while(!clickOut && (imNum <= i360))
     {
         temps = vpTime::measureTimeMs();
@@ -448,19 +720,27 @@ int main(int argc, char **argv)
                 if(nbPass > 0)
                 {
                     key_dMc.buildFrom(r_to_save);
-                    fSet_req = fSet_des;
-                    gyro.buildFrom(fSet_req);
+                    if(!compassOnly)
+                    {
+                        fSet_req = fSet_des;
+                        gyro.buildFrom(fSet_req);
+                    }
+                    compass_req.swap(compass_des);
                     r.set(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
                 }
                 break;
             }
             case 2: //odometrie a images cles
             {
-                if( (nbPass > 0) && (err[nbPass-1] > seuilErr) )
+                if( (nbPass > 0) && (err[nbPass-1] > keyThreshold) )
                 {
                     key_dMc.buildFrom(r_to_save);
-                    fSet_req = fSet_des; //check si ce n'est pas encore la precedente !
-                    gyro.buildFrom(fSet_req);
+                    if(!compassOnly)
+                    {
+                        fSet_req = fSet_des; //check si ce n'est pas encore la precedente !
+                        gyro.buildFrom(fSet_req);
+                    }
+                    compass_req.swap(compass_des);
                     v_keyImageNum.push_back(nbPass-1);
                     r.set(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
                 }
@@ -493,15 +773,19 @@ int main(int argc, char **argv)
         vpDisplay::flush(I_des);
         
         // Desired feature set setting from the current image
-        prRegularlySampledCSImage<unsigned char> IS_des(subdivLevel);
-        IS_des.setInterpType(prInterpType::IMAGEPLANE_BILINEAR);
-        //IS_des.buildFromTwinOmni(I_des, stereoCam, &Mask);
-        IS_des.buildFromEquiRect(I_des, ecam, &Mask);
-        IS_des.toAbsZN();
-        
-        //calculer en parallele un fSet_des avec lambda_g /= 10 pour les dernières itérations --> précision accrue, sans perdre de temps
-        fSet_des.buildFrom(IS_des, GS, GS_sample, poseJacobianCompute); // Goulot !
-        std::cout << "nb features : " << fSet_des.set.size() << std::endl;
+        if(!compassOnly)
+        {
+            //IS_des.buildFromTwinOmni(I_des, stereoCam, &Mask);
+            IS_des.buildFromEquiRect(I_des, ecam, &Mask);
+            IS_des.toAbsZN();
+            
+            //calculer en parallele un fSet_des avec lambda_g /= 10 pour les dernières itérations --> précision accrue, sans perdre de temps
+            fSet_des.buildFrom(IS_des, GS, GS_sample, poseJacobianCompute); // Goulot !
+            std::cout << "nb features : " << fSet_des.set.size() << std::endl;
+        }
+
+        if(compass)
+            yawCompass.profile(I_des, Mask, compass_des);
         
         // if there is a file provided as initial poses, they are used instead of other strategies
         if(ficInit)
@@ -515,8 +799,14 @@ int main(int argc, char **argv)
         }
 //        else
 //        {
+            // global yaw of the compass: the desired columns are those of the request image shifted by the yaw (buildFromEquiRect longitude growing with the columns)
+            if(compass)
+            {
+                r.set(0.0, 0.0, 0.0, 0.0, yawCompass.yaw(compass_req, compass_des, &compassCorr), 0.0);
+                std::cout << "compass yaw : " << r[4]*180./M_PI << " deg" << std::endl;
+            }
             // trying to select the best initial 3D orientation guess
-            if(nbTries > 1)
+            else if(nbTries > 1)
             {
                 vpPoseVector r_best_init, r_try;
                 double err_min_init = 1e20;
@@ -584,8 +874,15 @@ int main(int argc, char **argv)
 //        }
         
         // register the request feature set over the desired one and save the optimal MPP-SSD
-        err.push_back(gyro.track(fSet_des, r, 1.0, robust)); //0);//
+        if(compassOnly)
+            err.push_back(1. - compassCorr);
+        else
+            err.push_back(gyro.track(fSet_des, r, 1.0, robust)); //0);//
     
+        //new key image: IS_des still holds the current image, sampled again with the pose Jacobian
+        if(!compassOnly && (estimationType == 2) && (err[nbPass] > keyThreshold))
+            fSet_des.buildFrom(IS_des, GS, GS_sample, true);
+
         v_temps.push_back(vpTime::measureTimeMs()-temps);
         std::cout << "Pass " << nbPass << " time : " << v_temps[nbPass] << " ms" << std::endl;
         
@@ -600,7 +897,10 @@ int main(int argc, char **argv)
         clickOut=vpDisplay::getClick(I_req,false);
         
         vpImage<unsigned char> I_r(I_des.getHeight(), I_des.getWidth());
-        if(stabilisation)
+        //no spherical image with the compass alone: the yaw is a shift of the columns
+        if(compassOnly)
+            yawEquiRect(stabilisation ? I_des : I_req, stabilisation ? -r_to_save[4] : r[4], I_r);
+        else if(stabilisation)
         {
             vpPoseVector ir;
             ir.buildFrom(vpHomogeneousMatrix(r_to_save).inverse());
@@ -355,7 +355,8 @@ int main(int argc, char **argv)
     vpPoseVector r, r_to_save;
     vpHomogeneousMatrix key_dMc, dMd_prec;
 
-    bool poseJacobianCompute = true;
+    // the desired features set needs its pose Jacobian only when it becomes the request set: at every image for odometry, for the key images only otherwise
+    bool poseJacobianCompute = (estimationType == 1);
     // activate the M-Estimator
     bool robust = false; // true;//
     vpImage<unsigned char> I_des;
@@ -509,6 +510,10 @@ int main(int argc, char **argv)
         // register the request feature set over the desired one and save the optimal MPP-SSD
         err.push_back(gyro.track(fSet_des, r, 1.0, robust));
 
+        // key image switch: the desired features set is built again from IS_des, this time with its pose Jacobian
+        if ((estimationType == 2) && (err[nbPass] > seuilErr))
+            fSet_des.buildFrom(IS_des, GS, GS_sample, true);
+
         v_temps.push_back(vpTime::measureTimeMs() - temps);
         std::cout << "Pass " << nbPass << " time : " << v_temps[nbPass] << " ms" << std::endl;
 
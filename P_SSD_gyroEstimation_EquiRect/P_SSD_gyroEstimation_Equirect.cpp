@@ -356,7 +356,8 @@ int main(int argc, char **argv)
     vpPoseVector r, r_to_save;
     vpHomogeneousMatrix key_dMc, dMd_prec;
 
-    bool poseJacobianCompute = true;
+    // pose Jacobian of every desired features set for odometry, of the key images only (added after tracking) with key images, of none for pure gyro
+    bool poseJacobianCompute = (estimationType == 1);
     // activate the M-Estimator
     bool robust = false; // true;//
     vpImage<unsigned char> I_des;
@@ -510,6 +511,10 @@ int main(int argc, char **argv)
         // register the request feature set over the desired one and save the optimal MPP-SSD
         err.push_back(gyro.track(fSet_des, r, 1.0, robust));
 
+        // the current image is the next key image: its features set gets the pose Jacobian the next gyro.buildFrom needs
+        if ((estimationType == 2) && (err[nbPass] > seuilErr))
+            fSet_des.buildFrom(IS_des, GS, GS_sample, true);
+
         v_temps.push_back(vpTime::measureTimeMs() - temps);
         std::cout << "Pass " << nbPass << " time : " << v_temps[nbPass] << " ms" << std::endl;
 